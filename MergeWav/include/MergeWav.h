@@ -1,5 +1,34 @@
 #include "ssad.h"
 #include "wavheader.h"
+#include "fsplice.h"
 
-int seg_write_file(float start, float end, FILE* infp, FILE* outfp);
-int MergeWav(const char* infilename, const char* outfilename);
\ No newline at end of file
+/* default gap written after each segment, in ms */
+#define MERGE_PAD_MS 150
+
+/* per file processing options */
+typedef struct {
+	float minlen;               /* minimum silence length in s (0.5)           */
+	float threshold;            /* deviation wrt speech std. deviation (0)     */
+	int channel;                /* channel to analyse from 1, 0 for mean (1)   */
+	int stream;                 /* single pass processing (0)                  */
+	int nthreads;               /* profile threads, 0 for one per CPU (0)      */
+	unsigned long nbins;        /* histogram EM bins, 0 for exact EM (0)       */
+	float warmup;               /* stream model estimation period in s (30)    */
+	float lookahead;            /* stream decision delay in s (0)              */
+	float halflife;             /* online model memory in s, 0 for fixed (0)   */
+	float gap;                  /* gap between segments in ms (MERGE_PAD_MS)   */
+	int gapmode;                /* silence, noise or crossfade (WAVOUT_SILENCE)*/
+	mwstats_t *stats;           /* counters to fill in, or none (NULL)         */
+} mergeopt_t;
+
+void mergeopt_init(mergeopt_t *opt);
+
+int seg_write_file(aseg_pos_t start, aseg_pos_t end, head_pama fmt, FILE* infp, wavout_t* out);
+int seg_write_map(aseg_pos_t start, aseg_pos_t end, head_pama fmt, const char* data, size_t datalen, wavout_t* out);
+int MergeWav(const char* infilename, const char* outfilename);
+int MergeWavOpt(const char* infilename, const char* outfilename, const mergeopt_t *opt);
+int MergeWavStream(const char* infilename, const char* outfilename);
+int MergeWavOnline(const char* infilename, const char* outfilename);
+int MergeWavBatch(const char* manifest, int nthreads, const char* report);
+int MergeWavBench(const char* spec, const char* report);
+int MergeWavCheck(void);
\ No newline at end of file
@@ -84,6 +84,27 @@ typedef struct asseg_s {
   struct asseg_s *prev;         /* next segment in a "transcription"          */
 } asseg_t;
 
+/*
+   segment table: packed segments with sample boundaries (see segtab.c)
+*/
+typedef unsigned long long aseg_pos_t; /* sample index, 64 bits everywhere    */
+
+typedef struct {
+  aseg_pos_t st;                /* first sample                               */
+  aseg_pos_t et;                /* last sample + 1                            */
+  unsigned short label;         /* label index in the table                   */
+  float score;                  /* segment score                              */
+} segrec_t;
+
+typedef struct {
+  float Fs;                     /* sample rate                                */
+  unsigned long n;              /* number of segments                         */
+  unsigned long m;              /* maximum number of segments                 */
+  segrec_t *seg;                /* segments                                   */
+  unsigned short nlabels;       /* number of labels                           */
+  char **label;                 /* label strings, names separated by '+'      */
+} segtab_t;
+
 /*
    Gaussian model definition
 */
@@ -170,6 +191,71 @@ void seg_label_free(
   seglab_t *                    /* label to free                              */
 );
 
+     /* -------------------------------------- */
+     /* ----- segment table functions ----- */
+     /* -------------------------------------- */
+
+/* allocate an empty segment table */
+segtab_t *seg_tab_alloc(
+  float                         /* sample rate                                */
+);
+
+/* free a segment table */
+void seg_tab_free(
+  segtab_t *                    /* table                                      */
+);
+
+/* return the index of a label string, adding it if needed, or -1 */
+int seg_tab_label(
+  segtab_t *,                   /* table                                      */
+  const char *                  /* labels separated by '+'                    */
+);
+
+/* append a segment, return its address or NULL in case of error */
+segrec_t *seg_tab_append(
+  segtab_t *,                   /* table                                      */
+  aseg_pos_t,                   /* first sample                               */
+  aseg_pos_t,                   /* last sample + 1                            */
+  unsigned short,               /* label index                                */
+  float                         /* score                                      */
+);
+
+/* sort segments by start (then end) sample */
+void seg_tab_sort(
+  segtab_t *                    /* table                                      */
+);
+
+/* merge same label segments closer than gap samples, return the new
+   number of segments */
+unsigned long seg_tab_merge(
+  segtab_t *,                   /* sorted table                               */
+  aseg_pos_t                    /* maximum gap (num. samples)                 */
+);
+
+/* return the index of the segment containing a sample, or -1 */
+long seg_tab_find(
+  const segtab_t *,             /* sorted table                               */
+  aseg_pos_t                    /* sample                                     */
+);
+
+/* convert a segment list to a table */
+segtab_t *seg_list_to_tab(
+  const asseg_t *,              /* pointer to the first segment               */
+  float                         /* sample rate                                */
+);
+
+/* convert a table to a segment list */
+asseg_t *seg_tab_to_list(
+  const segtab_t *              /* table                                      */
+);
+
+/* write a segment table */
+int seg_tab_write(
+  const segtab_t *,             /* table                                      */
+  const char *,                 /* output stream name (or NULL for stdout)    */
+  const char *                  /* format string (lsep)                       */
+);
+
      /* ------------------------------------ */
      /* ----- label handling functions ----- */
      /* ------------------------------------ */
@@ -0,0 +1,23 @@
+#ifndef _fsplice_h_
+#define _fsplice_h_
+
+#include <stdio.h>
+
+/* kernel side file to file copies (copy_file_range, sendfile) */
+#ifdef __linux__
+# define HAVE_FILE_SPLICE 1
+#endif
+
+/* copy len bytes from offset off of infp to the current position of
+   outfp without going through user space. Return the number of bytes
+   copied, which is 0 if not supported: the caller copies the rest. */
+long long fsplice(FILE *infp, long long off, long long len, FILE *outfp);
+
+/* seek to a 64 bits offset. Return 0 if ok. */
+int fseek64(FILE *f, long long off, int whence);
+
+/* write len null bytes at the current position of outfp, as a hole
+   when outfp is at the end of file. Return 0 if ok. */
+int fzero(FILE *outfp, long long len);
+
+#endif /* _fsplice_h_ */
@@ -0,0 +1,35 @@
+#ifndef _mthread_h_
+#define _mthread_h_
+
+/* minimal portable threads: Win32 threads or POSIX threads */
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+typedef HANDLE mthread_t;
+typedef SRWLOCK mmutex_t;
+# define MMUTEX_INITIALIZER SRWLOCK_INIT
+#else
+# include <pthread.h>
+typedef pthread_t mthread_t;
+typedef pthread_mutex_t mmutex_t;
+# define MMUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#endif
+
+/* start a thread running fn(arg), return 0 if ok */
+int mthread_create(mthread_t *t, void (*fn)(void *), void *arg);
+
+/* wait for a thread to terminate */
+void mthread_join(mthread_t t);
+
+/* number of online processors */
+int mthread_ncpu(void);
+
+/* wall clock time in seconds */
+double mthread_clock(void);
+
+void mmutex_init(mmutex_t *m);
+void mmutex_lock(mmutex_t *m);
+void mmutex_unlock(mmutex_t *m);
+void mmutex_destroy(mmutex_t *m);
+
+#endif /* _mthread_h_ */
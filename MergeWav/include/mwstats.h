@@ -0,0 +1,44 @@
+#ifndef _mwstats_h_
+#define _mwstats_h_
+
+#include <stdio.h>
+
+/* processing stages, timed when counters are requested */
+#define MWSTATS_OPEN 0            /* input stream opening                     */
+#define MWSTATS_PROFILE 1         /* energy profile                           */
+#define MWSTATS_EM 2              /* bi-gaussian EM                           */
+#define MWSTATS_SEG 3             /* profile to segments                      */
+#define MWSTATS_WRITE 4           /* segment and gap writes                   */
+#define MWSTATS_STREAM 5          /* single pass detection and writes         */
+#define MWSTATS_HEADER 6          /* output header rewrite                    */
+#define MWSTATS_NSTAGES 7
+
+/* counters of one file processing */
+typedef struct {
+  unsigned long long nbytes_read; /* sample bytes read or mapped              */
+  unsigned long long nbytes_written; /* bytes written, header included        */
+  unsigned long nfread;           /* fread() calls on samples                 */
+  unsigned long nfwrite;          /* fwrite() calls, kernel side copies incl. */
+  unsigned long nfseek;           /* fseek() calls, file holes included       */
+  unsigned long nresize;          /* energy profile reallocations             */
+  unsigned long niter;            /* EM iterations                            */
+  unsigned long nseg;             /* segments written                         */
+  double t[MWSTATS_NSTAGES];      /* wall time per stage in s                 */
+} mwstats_t;
+
+/* add n to a counter of p, if counters are requested (p not NULL):
+   n is not evaluated otherwise, so it must have no side effect */
+#define MWSTATS_ADD(p, field, n) do { if (p) (p)->field += (n); } while (0)
+
+void mwstats_init(mwstats_t *p);
+
+/* start of a stage: wall clock time if p is not NULL, 0 otherwise */
+double mwstats_clock(const mwstats_t *p);
+
+/* end of a stage started at t: add its wall time to p if not NULL */
+void mwstats_stage(mwstats_t *p, int stage, double t);
+
+/* write p out as a JSON object about input to fn ("-" for stdout). Return 0 if ok. */
+int mwstats_write(const mwstats_t *p, const char *input, const char *fn);
+
+#endif /* _mwstats_h_ */
@@ -112,6 +112,13 @@
 # ifdef SPHERE
 #  define SPRO_SIG_SPHERE_FORMAT 2   /* SHERE signal format                   */
 # endif
+# define SPRO_SIG_MMAP_FORMAT 3      /* memory mapped WAVE data chunk         */
+
+/*
+ * WAVE format tags
+ */
+# define SPRO_WAVE_FORMAT_PCM 0x0001        /* linear PCM                     */
+# define SPRO_WAVE_FORMAT_EXTENSIBLE 0xFFFE /* sub format in the fmt chunk    */
 
 /*
  * Weighting windows
@@ -147,6 +154,7 @@ typedef struct {
   unsigned short dim;           /* actual vector dimension                    */
   unsigned long n;              /* number of vectors                          */
   unsigned long m;              /* maximum number of vectors                  */
+  unsigned long nresize;        /* number of reallocations so far             */
   spf_t *s;                     /* pointer to features                        */
 } spfbuf_t;
 
@@ -204,15 +212,31 @@ typedef struct {
   char *name;                   /* stream file name (or NULL if stdin)        */
   FILE *f;                      /* input stream (FILE or SP_FILE)             */
   int format;                   /* stream format                              */
-  unsigned long nsamples;       /* total number of samples in stream          */
-  unsigned long nread;          /* number of samples read from stream         */
+  unsigned long long nsamples;  /* total number of samples in stream          */
+  unsigned long long nread;     /* number of samples read from stream         */
+  unsigned long nfread;         /* number of fread() calls on samples         */
   float Fs;                     /* sample rate                                */
   unsigned short nchannels;     /* number of channels                         */
   int nbps;                     /* number of bytes per samples.channel        */
   int swap;                     /* to swap or not to swap?                    */
   sigbuf_t *buf;                /* input buffer                               */
+  char *map;                    /* mapped file (SPRO_SIG_MMAP_FORMAT only)    */
+  size_t maplen;                /* mapped length in bytes                     */
+  size_t dataoff;               /* offset of the samples in the file          */
+  unsigned long bp;             /* get_next_sig_frame() buffer position       */
+  double prev;                  /* get_next_sig_frame() pre-emphasis memory   */
 } sigstream_t;                  /* signal input stream                        */
 
+typedef struct {
+  unsigned short format;        /* format tag (sub format if extensible)      */
+  unsigned short nchannels;     /* number of channels                         */
+  unsigned long Fs;             /* sample rate                                */
+  unsigned short blockalign;    /* number of bytes per sample frame           */
+  unsigned short nbits;         /* number of bits per sample                  */
+  unsigned long long dataoff;   /* offset of the first sample                 */
+  unsigned long long datasize;  /* data chunk size (in bytes)                 */
+} sigwavehdr_t;                 /* WAVE (RIFF, RF64 or BW64) file header      */
+
      /* -------------------------------------------  */
      /* ----- signal stream related functions -----  */
      /* -------------------------------------------  */
@@ -260,10 +284,20 @@ unsigned long sig_stream_read(
   sigstream_t *                 /* signal stream                              */
 );
 
+/* read a WAVE header up to the first sample (return 0 if ok)  */
+int sig_wave_header(
+  FILE *,                       /* input stream, at the beginning of the file */
+  sigwavehdr_t *                /* output header                              */
+);
+
+/* samples of a mapped stream (NULL for other formats)  */
+# define sig_stream_map_data(p)  (((p)->map) ? ((p)->map + (p)->dataoff) : NULL)
+# define sig_stream_map_size(p)  ((size_t)(p)->nsamples * (p)->nchannels * (p)->nbps)
+
 /* get next frame from input stream  */
 int get_next_sig_frame(
   sigstream_t *,                /* signal input stream                        */
-  int,                          /* channel number (starts with 1)             */
+  int,                          /* channel number (starts with 1, 0 for mean) */
   int,                          /* frame length (in samples)                  */
   int,                          /* frame shift (in samples)                   */
   float,                        /* pre-emphasis coefficient                   */
@@ -278,13 +312,65 @@ int sig_pcm16_stream_init(sigstream_t *, const char *);
 unsigned long sig_pcm16_stream_read(sigstream_t *);
 int sig_wave_stream_init(sigstream_t *, const char *);
 unsigned long sig_wave_stream_read(sigstream_t *);
+int sig_mmap_stream_init(sigstream_t *, const char *);
+unsigned long sig_mmap_stream_read(sigstream_t *);
+void sig_mmap_stream_close(sigstream_t *);
 #  ifdef SPHERE
 int sig_sphere_stream_init(sigstream_t *, const char *);
 unsigned long sig_sphere_stream_read(sigstream_t *);
 #  endif /* SPHERE  */
+# endif /* _sig_c_  */
+
+/* n'th sample of a buffer of m bytes samples */
 //double getsample(void *, unsigned long, unsigned short);
 double getsample(short *p, unsigned long n, int m);
-# endif /* _sig_c_  */
+
+/* channel (or mean of the channels if 0) of the sample frame at sample n */
+double getchsample(short *p, unsigned long n, int m, unsigned short nch, int ch);
+
+/* conversion of n sample frames of nch interleaved channels starting
+   at p to the sample_t values of channel ch, as getchsample() returns them */
+typedef void (*sig_conv_t)(const char *p, unsigned long n, unsigned short nch, int ch, sample_t *s);
+
+/* converter specialized for m bytes samples, nch channels and channel ch */
+sig_conv_t sig_converter(int m, unsigned short nch, int ch);
+
+/*
+ * Frame views: the samples of a channel are converted once into a
+ * contiguous buffer and frames are handed out as views into it.
+ */
+# define SIG_FRAMES_BLOCK 8192        /* converted samples beyond a frame     */
+
+typedef struct {
+  sigstream_t *f;               /* input stream                               */
+  int ch;                       /* channel (from 1, 0 for the mean)           */
+  unsigned short l;             /* frame length (num. samples)                */
+  unsigned short d;             /* frame shift (num. samples)                 */
+  sig_conv_t conv;              /* sample frame converter                     */
+  sample_t *r;                  /* converted samples                          */
+  unsigned long m;              /* maximum number of converted samples        */
+  unsigned long n;              /* actual number of converted samples         */
+  unsigned long pos;            /* first sample of the next frame in r        */
+  unsigned long skip;           /* samples to drop before converting (d > l)  */
+  unsigned long bp;             /* position in the stream buffer              */
+  spsig_t view;                 /* last frame handed out                      */
+} sigframes_t;                  /* frame views over a signal stream           */
+
+/* frames of l samples every d samples of channel ch of a stream */
+sigframes_t *sig_frames_open(
+  sigstream_t *,                /* signal input stream                        */
+  int,                          /* channel number (starts with 1, 0 for mean) */
+  unsigned short,               /* frame length (in samples)                  */
+  unsigned short                /* frame shift (in samples)                   */
+);
+
+/* next frame, read only and valid until the next call (NULL at the end)  */
+const spsig_t *sig_frames_next(sigframes_t *);
+
+void sig_frames_close(sigframes_t *);
+
+/* reverse in place the byte order of n samples of m bytes */
+void sig_swap(void *, unsigned long, size_t);
 
      /* ---------------------------------------------------  */
      /* ----- feature stream header related functions -----  */
@@ -354,8 +440,8 @@ spf_t *spf_buf_resize(
 );
 
 /* append feature vector to buffer -- if buffer is full and resize block 
-   size is not null, increment buffer size by block size, otherwise 
-   return an error. Return a pointer to the appended vector in the 
+   size is not null, increment buffer size by block size or half its 
+   size, whichever is larger, otherwise return an error. Return a pointer to the appended vector in the 
    buffer or NULL in case of error.  */
 spf_t *spf_buf_append(
   spfbuf_t *,                   /* feature buffer                             */
@@ -553,6 +639,60 @@ spsig_t *sig_weight(
   float *                       /* weighting window                           */
 );
 
+      /* -------------------------------------  */
+      /* ----- 16 bits PCM energy kernels -----  */
+      /* -------------------------------------  */
+/*
+ * The PCM energy kernels are implemented in energy.c
+  */
+
+# define SPRO_KERNEL_QUERY -2        /* return the kernel in use              */
+# define SPRO_KERNEL_AUTO -1         /* best kernel for this processor        */
+# define SPRO_KERNEL_C 0             /* plain C                               */
+# define SPRO_KERNEL_SSE2 1          /* SSE2                                  */
+# define SPRO_KERNEL_AVX2 2          /* AVX2                                  */
+
+/* select the energy and EM kernels (return the kernel in use)  */
+int sig_pcm16_kernel(
+  int                           /* requested kernel                           */
+);
+
+/* exact sum of squares of 16 bits samples  */
+unsigned long long sig_pcm16_sumsq(
+  const short *,                /* first sample                               */
+  unsigned long,                /* number of samples                          */
+  unsigned short                /* sample stride (number of channels)         */
+);
+
+/* frame energy of 16 bits samples (same as sig_normalize())  */
+double sig_pcm16_energy(
+  const short *,                /* first sample                               */
+  unsigned long,                /* number of samples                          */
+  unsigned short                /* sample stride (number of channels)         */
+);
+
+/* energies of overlapping frames, each sample squared once  */
+int sig_pcm16_energies(
+  const short *,                /* first sample of the first frame            */
+  unsigned long,                /* number of frames                           */
+  unsigned short,               /* frame length (in samples)                  */
+  unsigned short,               /* frame shift (in samples)                   */
+  unsigned short,               /* sample stride (number of channels)         */
+  spf_t *                       /* output energies                            */
+);
+
+/* energies of overlapping frames of any PCM format  */
+int sig_energies(
+  const char *,                 /* first sample frame of the first frame      */
+  unsigned long,                /* number of frames                           */
+  unsigned short,               /* frame length (in samples)                  */
+  unsigned short,               /* frame shift (in samples)                   */
+  int,                          /* number of bytes per sample                 */
+  unsigned short,               /* number of channels                         */
+  int,                          /* channel (starts with 1, 0 for mean)        */
+  spf_t *                       /* output energies                            */
+);
+
      /* ---------------------------------------------  */
      /* ----- feature data convertion functions -----  */
      /* ---------------------------------------------  */
@@ -2,6 +2,7 @@
 #define _ssad_h_
 
 #include "audioseg.h"
+#include "wavout.h"
 #include <STRING.H>
 #include <STDLIB.H>
 #include <MATH.H>
@@ -26,16 +27,72 @@ typedef struct {
   double c[2];
 } bigauss_t;
 
-asseg_t *silence_detection(sigstream_t *s);
+/* hard assignment statistics (see bigauss.c) */
+typedef struct {
+  unsigned long n[2];             /* number of features per gaussian          */
+  double m[2];                    /* sum of the features                      */
+  double v[2];                    /* sum of the squared features              */
+  double llk;                     /* total log-likelihood                     */
+} bigauss_stat_t;
+
+/* histogram of the features (see bigauss.c) */
+typedef struct {
+  unsigned long nbins;            /* number of bins                           */
+  double lo;                      /* lower bound of the first bin             */
+  double width;                   /* bin width                                */
+  unsigned long *n;               /* number of features per bin               */
+  double *s1;                     /* sum of the features per bin              */
+  double *s2;                     /* sum of the squared features per bin      */
+} bigauss_hist_t;
+
+/* detector settings and state: one per concurrent detection */
+typedef struct {
+  int channel;                    /* channel to analyse (from 1, 0: mean)     */
+  float st, et;                   /* start and end times                      */
+  float fm_l;                     /* frame length in ms                       */
+  float fm_d;                     /* frame shift in ms                        */
+  int win;                        /* weighting window                         */
+  float threshold;                /* deviation w.r.t. standard deviation      */
+  float minlen;                   /* minimum silence segment length           */
+  int ofmt;                       /* output format                            */
+  int uselog;                     /* use log-energy rather than energy        */
+  int nthreads;                   /* energy profile threads (0: one per CPU)  */
+  unsigned long nbins;            /* histogram EM bins (0: EM on all frames)  */
+  float warmup;                   /* stream model estimation period in s      */
+  float lookahead;                /* stream decision delay in s               */
+  float halflife;                 /* stream model memory in s (0: fixed model)*/
+  mwstats_t *stats;               /* instrumentation counters (NULL: none)    */
+} ssad_ctx_t;
+
+void ssad_ctx_init(ssad_ctx_t *ctx);
+
+segtab_t *silence_detection(ssad_ctx_t *ctx, sigstream_t *s);
+
+spfbuf_t *get_energy_profile(ssad_ctx_t *ctx, sigstream_t *s, unsigned short l, unsigned short d, double *emin, double *emax);
 
-spfbuf_t *get_energy_profile(sigstream_t *s, unsigned short l, unsigned short d, double *emin, double *emax);
+spfbuf_t *get_energy_profile_chunked(ssad_ctx_t *ctx, sigstream_t *s, unsigned short l, unsigned short d, double *emin, double *emax);
 
 void init_bigauss(bigauss_t *bg, double emin, double emax);
 
-void buf_to_bigauss(spfbuf_t *e, bigauss_t *bg, int maxiter, double epsilon);
+int buf_to_bigauss(spfbuf_t *e, bigauss_t *bg, int maxiter, double epsilon, int nthreads);
+
+int hist_to_bigauss(bigauss_hist_t *h, bigauss_t *bg, int maxiter, double epsilon);
+
+int bigauss_stats(bigauss_t *bg, spfbuf_t *e, int nthreads, bigauss_stat_t *st);
+
+bigauss_hist_t *bigauss_hist(spfbuf_t *e, double emin, double emax, unsigned long nbins);
+
+void bigauss_hist_free(bigauss_hist_t *h);
+
+void bigauss_hist_stats(bigauss_t *bg, bigauss_hist_t *h, bigauss_stat_t *st);
+
+int profile_to_seg(ssad_ctx_t *ctx, spfbuf_t *e, bigauss_t *bg, unsigned short d, float Fs, segtab_t *tab);
+
+int bigauss_label(ssad_ctx_t *ctx, bigauss_t *bg, double v);
 
-asseg_t *profile_to_seg(spfbuf_t *e, bigauss_t *bg, float frate);
+int add_seg(segtab_t *tab, aseg_pos_t st, aseg_pos_t et, int label);
 
-asseg_t *add_seg(asseg_t **seg, float st, float et, int label);
+/* single pass detection and merge (see ssad_stream.c) */
+int ssad_stream_merge(ssad_ctx_t *ctx, sigstream_t *s, wavout_t *out);
 
 #endif /* _ssad_h_ */
\ No newline at end of file
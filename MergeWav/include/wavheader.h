@@ -9,10 +9,28 @@ typedef struct{
     short channels;
     short bits;
     int rate;
-	int datasize;
+	long long datasize; /* number of sample frames */
+	long long dataoff;  /* offset of the first sample (read only) */
+	int layout;         /* header written by wav_write_header (WAV_LAYOUT_AUTO) */
 }head_pama;
 
+/* data size written to non seekable outputs, whose length is unknown */
+#define WAV_STREAM_DATASIZE 0x3FFFFFE0
+
+/* largest data chunk of a RIFF file, whose sizes are 32 bits */
+#define WAV_RIFF_MAXDATA (0xFFFFFFFFULL-36)
+
+/* header layouts: 44 bytes RIFF header, or 80 bytes RF64 header if the data
+   exceeds WAV_RIFF_MAXDATA (AUTO); always a RIFF header, whose sizes are then
+   capped (RIFF); always 80 bytes, a RIFF header keeping room for the ds64 chunk
+   in a JUNK chunk until the data exceeds the limit (RESERVE), so that a header
+   written before the data size is known can be rewritten in place */
+#define WAV_LAYOUT_AUTO 0
+#define WAV_LAYOUT_RIFF 1
+#define WAV_LAYOUT_RESERVE 2
+
 head_pama wav_header_read(const char* wavfile);
-void wav_write_header(FILE* fp,head_pama pt);
+int wav_format_supported(head_pama pt);
+int wav_write_header(FILE* fp,head_pama pt);
 
 #endif
\ No newline at end of file
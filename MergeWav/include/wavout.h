@@ -0,0 +1,54 @@
+#ifndef _wavout_h_
+#define _wavout_h_
+
+#include <stdio.h>
+#include "wavheader.h"
+#include "mwstats.h"
+
+/* gap between two merged segments */
+#define WAVOUT_SILENCE 0          /* null samples                             */
+#define WAVOUT_NOISE 1            /* low level white noise (comfort noise)    */
+#define WAVOUT_CROSSFADE 2        /* segments overlapped and crossfaded       */
+
+#define WAVOUT_NOISE_DB -60.0     /* comfort noise RMS level (dB full scale)  */
+#define WAVOUT_BLOCK 8192         /* gap block length (num. sample frames)    */
+
+/* output of the merged sample frames */
+typedef struct {
+  FILE *f;                        /* output stream                            */
+  int mode;                       /* gap mode                                 */
+  unsigned long ngap;             /* gap length (num. sample frames)          */
+  int nbps;                       /* number of bytes per sample               */
+  unsigned short nch;             /* number of channels                       */
+  unsigned short bpf;             /* number of bytes per sample frame         */
+  char *blk;                      /* gap frames, or crossfade scratch frames  */
+  unsigned long nblk;             /* block length (num. sample frames)        */
+  char *tail;                     /* crossfade: last frames of a segment      */
+  unsigned long ntail;            /* number of frames held in tail            */
+  unsigned long nfade;            /* tail frames faded out into the next one  */
+  unsigned long fpos;             /* tail frames faded out so far             */
+  long long nwritten;             /* number of sample frames written          */
+  mwstats_t *stats;               /* I/O counters, or NULL                    */
+} wavout_t;
+
+/* output of fmt sample frames to f, with gaps of gap ms in the given mode */
+wavout_t *wavout_alloc(FILE *f, head_pama fmt, int mode, float gap);
+
+void wavout_free(wavout_t *p);
+
+/* write n sample frames of a segment. Return 0 if ok. */
+int wavout_write(wavout_t *p, const char *b, unsigned long n);
+
+/* write n sample frames of a segment, read from offset off of infp */
+int wavout_copy(wavout_t *p, FILE *infp, long long off, unsigned long long n);
+
+/* close the current segment with a gap. Return 0 if ok. */
+int wavout_gap(wavout_t *p);
+
+/* write the frames still held back at the end of the output */
+int wavout_flush(wavout_t *p);
+
+/* set the n'th m bytes sample of a buffer, as getsample() reads it back */
+void putsample(char *p, unsigned long n, int m, double v);
+
+#endif /* _wavout_h_ */
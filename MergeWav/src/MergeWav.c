@@ -1,117 +1,369 @@
 #include "MergeWav.h"
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
-int seg_write_file(float start, float end, FILE* infp, FILE* outfp)
+static int merge_stream(const char* infilename, const char* outfilename, ssad_ctx_t *ctx, const mergeopt_t *opt);
+
+int seg_write_file(aseg_pos_t start, aseg_pos_t end, head_pama fmt, FILE* infp, wavout_t* out)
 {
-	char buffer[800];
-	char silSample[4800] = {0};
-	int sampleCount, readNum, restCount, startByte, i;
-	const float sampleRate = 16000.0;
-	const unsigned int bytespersample = 2;
-	startByte = (int)(start*sampleRate)*bytespersample+44;
-	sampleCount = ((int)((end-start)*sampleRate))*2;
-	fseek(infp, startByte, SEEK_SET);
-
-	if(sampleCount<800)
-	{
-		fread(buffer, 1, sampleCount, infp);
-		fwrite(buffer, 1, sampleCount, outfp);
-		fwrite(silSample, 1, 4800, outfp);
-	}
-	else
+	const unsigned int bytesperframe = (fmt.bits/8)*fmt.channels;
+
+	/* kernel side copy when available, buffered copy for the rest */
+	if(wavout_copy(out, infp, (long long)(start*bytesperframe)+fmt.dataoff, end-start))
+		return 1;
+
+	return wavout_gap(out) ? 1 : 0;
+}
+
+int seg_write_map(aseg_pos_t start, aseg_pos_t end, head_pama fmt, const char* data, size_t datalen, wavout_t* out)
+{
+	aseg_pos_t sampleCount, startByte;
+	const unsigned int bytesperframe = (fmt.bits/8)*fmt.channels;
+	startByte = start*bytesperframe;
+	sampleCount = (end-start)*bytesperframe;
+	if(startByte > datalen)
+		startByte = datalen;
+	if(sampleCount > datalen-startByte)
+		sampleCount = datalen-startByte;
+
+	/* the segment is written straight from the mapped input */
+	if(wavout_write(out, data+(size_t)startByte, (unsigned long)(sampleCount/bytesperframe)))
+		return 1;
+
+	return wavout_gap(out) ? 1 : 0;
+}
+
+void mergeopt_init(mergeopt_t *opt)
+{
+	opt->minlen = 0.5;
+	opt->threshold = 0.0;
+	opt->channel = 1;
+	opt->stream = 0;
+	opt->nthreads = 0;
+	opt->nbins = 0;
+	opt->warmup = 30.0;
+	opt->lookahead = 0.0;
+	opt->halflife = 0.0;
+	opt->gap = MERGE_PAD_MS;
+	opt->gapmode = WAVOUT_SILENCE;
+	opt->stats = NULL;
+}
+
+/* detector settings for opt (defaults if NULL) */
+static void merge_ctx(const mergeopt_t *opt, ssad_ctx_t *ctx)
+{
+	ssad_ctx_init(ctx);
+	if(opt)
 	{
-		readNum = floor((double)sampleCount/sizeof(buffer));
-		restCount = sampleCount-readNum*sizeof(buffer);
-		for(i = 0; i<readNum; i++)
-		{
-			fread(buffer, 1, sizeof(buffer), infp);
-			fwrite(buffer, 1, sizeof(buffer), outfp);
-		}
-		fread(buffer, 1, restCount, infp);
-		fwrite(buffer, 1, restCount, outfp);
-		fwrite(silSample, 1, 4800, outfp);
+		ctx->minlen = opt->minlen;
+		ctx->threshold = opt->threshold;
+		ctx->channel = opt->channel;
+		ctx->nthreads = opt->nthreads;
+		ctx->nbins = opt->nbins;
+		ctx->warmup = opt->warmup;
+		ctx->lookahead = opt->lookahead;
+		ctx->halflife = opt->halflife;
+		ctx->stats = opt->stats;
 	}
-
-	return 0;
 }
 
 int MergeWav(const char* infilename, const char* outfilename)
 {
-	 FILE *infp, *outfp;
+	return MergeWavOpt(infilename, outfilename, NULL);
+}
+
+int MergeWavOpt(const char* infilename, const char* outfilename, const mergeopt_t *opt)
+{
+	 FILE *infp = NULL, *outfp;
+	 const char *data;
 
 	 sigstream_t *s;			          /* input signal stream                   */
-     asseg_t *seg;
-	 int format = SPRO_SIG_PCM16_FORMAT; /* signal file format                     */
-     float Fs = 16000.0;                /* input signal sample rate                */
+     segtab_t *segs;                   /* speech segments                          */
+     segrec_t *seg;
+	 int format = SPRO_SIG_WAVE_FORMAT; /* signal file format                      */
      int swap = 0;                     /* change input sample byte order           */
      size_t ibs = 10000000;            /* input buffer size                        */
 
-	 float start_time = 0.0, end_time = 0.0;
-	 int datasize;
-	 float temptime, datatime;
-	 head_pama header, pt={0,0,0};
-	 header=wav_header_read(infilename);
-	 if(header.bits != 16)
+	 unsigned long i;
+	 aseg_pos_t nsamples = 0;
+	 head_pama pt={0};
+	 ssad_ctx_t ctx;
+	 mergeopt_t defopt;
+	 wavout_t *out;
+	 int status = 0, nhdr;
+	 double t;
+
+	 if(opt == NULL)
+	 {
+		 mergeopt_init(&defopt);
+		 opt = &defopt;
+	 }
+	 merge_ctx(opt, &ctx);
+	 if(opt->stream || opt->halflife > 0.0)
+		 return merge_stream(infilename, outfilename, &ctx, opt);
+
+	 /* map the input if possible, read it through a buffer otherwise */
+	 t = mwstats_clock(opt->stats);
+	 if((s = sig_stream_open(infilename, SPRO_SIG_MMAP_FORMAT, 0.0, ibs, swap)) == NULL &&
+		(s = sig_stream_open(infilename, format, 0.0, ibs, swap)) == NULL)
 	 {
-		 printf("뾫Ϊ16bitsƵ!\n");
+		fprintf(stderr, "ssad error -- cannot open input signal stream %s\n", (infilename) ? (infilename) : "stdin");
+		return(1);
+	 }
+	 mwstats_stage(opt->stats, MWSTATS_OPEN, t);
+
+	 /* the header was read once by the stream */
+	 pt.bits = (short)(s->nbps*8);
+	 pt.channels = (short)s->nchannels;
+	 pt.rate = (int)s->Fs;
+	 pt.dataoff = (long long)s->dataoff;
+	 if(!wav_format_supported(pt) || ctx.channel > pt.channels)
+	 {
+		 printf("MergeWav: unsupported wave format (%d Hz, %d bits, %d channels) or channel!\n", pt.rate, pt.bits, pt.channels);
+		 sig_stream_close(s);
 		 return 1;
 	 }
+ 
+     if((segs = silence_detection(&ctx, s)) == NULL)
+	 {
+		 sig_stream_close(s);
+		 return(1);
+	 }
 
-	 if(header.channels != 1)
+	 data = sig_stream_map_data(s);
+#ifdef HAVE_FILE_SPLICE
+	 if(opt->gapmode != WAVOUT_CROSSFADE || opt->gap <= 0.0)
+		 data = NULL; /* kernel side copies need no user space copy at all */
+#endif
+	 if(data == NULL)
+		 infp = fopen(infilename,"rb");
+	 outfp = fopen(outfilename,"wb+");
+	 out = (outfp) ? wavout_alloc(outfp, pt, opt->gapmode, opt->gap) : NULL;
+	 if((data == NULL && infp == NULL) || out == NULL)
 	 {
-		 printf("뵥Ƶ!\n");
+		 fprintf(stderr, "MergeWav: cannot open %s\n", (outfp) ? (infilename) : (outfilename));
+		 if(infp)
+			 fclose(infp);
+		 if(outfp)
+			 fclose(outfp);
+		 wavout_free(out);
+		 sig_stream_close(s);
+		 seg_tab_free(segs);
 		 return 1;
 	 }
 
-	 if(header.rate != 16000)
+	 /* at most every segment and gap: room for a RF64 header if that exceeds 4 GB */
+	 t = mwstats_clock(opt->stats);
+	 out->stats = opt->stats;
+	 for(i = 0, seg = segs->seg; i < segs->n; i++, seg++)
+		 nsamples += seg->et-seg->st+out->ngap;
+	 pt.datasize = (long long)nsamples;
+	 pt.layout = (nsamples*out->bpf > WAV_RIFF_MAXDATA) ? WAV_LAYOUT_RESERVE : WAV_LAYOUT_RIFF;
+	 nhdr = wav_write_header(outfp, pt);
+	 MWSTATS_ADD(opt->stats, nbytes_written, nhdr);
+	 MWSTATS_ADD(opt->stats, nfwrite, 1);
+
+	 for(i = 0, seg = segs->seg; i < segs->n && status == 0; i++, seg++)
 	 {
-		printf("Ϊ16kƵ!\n");
-		return 1;
+		 if(data)
+			 status = seg_write_map(seg->st,seg->et,pt,data,sig_stream_map_size(s),out);
+		 else
+			 status = seg_write_file(seg->st,seg->et,pt,infp,out);
 	 }
+	 if(status == 0)
+		 status = wavout_flush(out);
+	 mwstats_stage(opt->stats, MWSTATS_WRITE, t);
 
-	 if((s = sig_stream_open(infilename, format, Fs, ibs, swap)) == NULL)
+	 /* the header holds the number of frames actually written */
+	 t = mwstats_clock(opt->stats);
+	 pt.datasize = out->nwritten;
+	 if(status == 0 && fseek(outfp, 0, SEEK_SET) == 0)
 	 {
-		fprintf(stderr, "ssad error -- cannot open input signal stream %s\n", (infilename) ? (infilename) : "stdin");
+		 nhdr = wav_write_header(outfp, pt);
+		 MWSTATS_ADD(opt->stats, nbytes_written, nhdr);
+		 MWSTATS_ADD(opt->stats, nfwrite, 1);
+	 }
+	 MWSTATS_ADD(opt->stats, nfseek, 1);
+	 if(infp)
+		 fclose(infp);
+	 if(fclose(outfp) != 0)
+		 status = 1;
+	 mwstats_stage(opt->stats, MWSTATS_HEADER, t);
+	 wavout_free(out);
+	 /* ----- clean memory ----- */
+     sig_stream_close(s);
+     seg_tab_free(segs);
+
+	 return status ? 1 : 0;
+}
+
+int MergeWavStream(const char* infilename, const char* outfilename)
+{
+	mergeopt_t opt;
+
+	mergeopt_init(&opt);
+	opt.stream = 1;
+
+	return MergeWavOpt(infilename, outfilename, &opt);
+}
+
+int MergeWavOnline(const char* infilename, const char* outfilename)
+{
+	mergeopt_t opt;
+
+	mergeopt_init(&opt);
+	opt.stream = 1;
+	opt.warmup = 2.0;
+	opt.lookahead = 0.5;
+	opt.halflife = 60.0;
+
+	return MergeWavOpt(infilename, outfilename, &opt);
+}
+
+/* "-" stands for stdin or stdout, e.g. to process live audio through pipes */
+static int merge_stream(const char* infilename, const char* outfilename, ssad_ctx_t *ctx, const mergeopt_t *opt)
+{
+	 FILE *outfp;
+	 sigstream_t *s;
+	 wavout_t *out;
+	 int status, nhdr;
+	 double t;
+	 int fromstdin = (strcmp(infilename, "-") == 0), tostdout = (strcmp(outfilename, "-") == 0);
+	 size_t ibs = (ctx->halflife > 0.0) ? 3200 : 65536; /* input buffer size: 0.1 s when live */
+	 head_pama pt={0};
+
+#ifdef _WIN32
+	 if(fromstdin)
+		 _setmode(_fileno(stdin), _O_BINARY);
+	 if(tostdout)
+		 _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+	 /* the header is decoded by the stream, not part of the signal */
+	 t = mwstats_clock(opt->stats);
+	 if((s = sig_stream_open((fromstdin) ? NULL : infilename, SPRO_SIG_WAVE_FORMAT, 0.0, ibs, 0)) == NULL)
+	 {
+		fprintf(stderr, "ssad error -- cannot open input signal stream %s\n", (fromstdin) ? "stdin" : infilename);
 		return(1);
 	 }
- 
-     if((seg = silence_detection(s)) == NULL)
-		 return(1);
+	 mwstats_stage(opt->stats, MWSTATS_OPEN, t);
 
-	 datasize = header.datasize;
-	 temptime= (float)datasize/header.rate;
-     datatime=temptime/2;
-	 pt.bits = header.bits;
-	 pt.channels = header.channels;
-	 pt.rate = header.rate;
+	 pt.bits = (short)(s->nbps*8);
+	 pt.channels = (short)s->nchannels;
+	 pt.rate = (int)s->Fs;
+	 if(!wav_format_supported(pt) || ctx->channel > pt.channels)
+	 {
+		 printf("MergeWavStream: unsupported wave format (%d Hz, %d bits, %d channels) or channel!\n", pt.rate, pt.bits, pt.channels);
+		 sig_stream_close(s);
+		 return 1;
+	 }
 
-	 infp = fopen(infilename,"rb+");
-	 outfp = fopen(outfilename,"wb+");
-	 fseek(outfp, 44, SEEK_SET);
+	 if((outfp = (tostdout) ? stdout : fopen(outfilename,"wb+")) == NULL)
+	 {
+		 sig_stream_close(s);
+		 return 1;
+	 }
+	 if((out = wavout_alloc(outfp, pt, opt->gapmode, opt->gap)) == NULL)
+	 {
+		 if(!tostdout)
+			 fclose(outfp);
+		 sig_stream_close(s);
+		 return 1;
+	 }
+
+	 /* the size is not known yet: seekable outputs get the header rewritten below,
+	    in place, with room for a RF64 header if the output may exceed 4 GB, i.e.
+	    for inputs of unknown length or over half the RIFF limit */
+	 pt.datasize = WAV_STREAM_DATASIZE;
+	 pt.layout = WAV_LAYOUT_RIFF;
+	 MWSTATS_ADD(opt->stats, nfseek, 1);
+	 if(fseek(outfp, 0, SEEK_CUR) == 0 &&
+		(fromstdin || s->nsamples*s->nchannels*s->nbps > WAV_RIFF_MAXDATA/2))
+		 pt.layout = WAV_LAYOUT_RESERVE;
+	 t = mwstats_clock(opt->stats);
+	 out->stats = opt->stats;
+	 nhdr = wav_write_header(outfp, pt);
+	 MWSTATS_ADD(opt->stats, nbytes_written, nhdr);
+	 MWSTATS_ADD(opt->stats, nfwrite, 1);
 
-	 while(seg)
+	 status = ssad_stream_merge(ctx, s, out);
+	 sig_stream_close(s);
+	 if(status == 0)
+		 status = wavout_flush(out);
+	 mwstats_stage(opt->stats, MWSTATS_STREAM, t);
+	 pt.datasize = out->nwritten;
+	 wavout_free(out);
+
+	 if(status)
 	 {
-		 start_time = get_seg_start_time(seg);
-		 end_time = get_seg_end_time(seg);
-		 seg_write_file(start_time,end_time,infp,outfp);
-		 pt.datasize += ((int)((end_time-start_time)*16000.0));
-		 pt.datasize += 4800;
-		 seg = seg->next;
+		 if(!tostdout)
+			 fclose(outfp);
+		 return 1;
 	 }
-	 fseek(outfp, 0, SEEK_SET);
-	 wav_write_header(outfp, pt);
-	 fclose(infp);
-	 fclose(outfp);
-	 /* ----- clean memory ----- */
-     sig_stream_close(s);
-     seg_list_free(seg);
+
+	 if(pt.layout == WAV_LAYOUT_RIFF && (unsigned long long)pt.datasize*(pt.bits/8)*pt.channels > WAV_RIFF_MAXDATA)
+		 fprintf(stderr, "MergeWavStream: %s exceeds the 4 GB RIFF limit, its header sizes are capped\n", outfilename);
+	 t = mwstats_clock(opt->stats);
+	 if(fseek(outfp, 0, SEEK_SET) == 0)
+	 {
+		 nhdr = wav_write_header(outfp, pt);
+		 MWSTATS_ADD(opt->stats, nbytes_written, nhdr);
+		 MWSTATS_ADD(opt->stats, nfwrite, 1);
+	 }
+	 MWSTATS_ADD(opt->stats, nfseek, 1);
+	 if(tostdout)
+		 fflush(outfp);
+	 else
+		 fclose(outfp);
+	 mwstats_stage(opt->stats, MWSTATS_HEADER, t);
 
 	 return 0;
 }
 
-void main()
+int main(int argc, char** argv)
 {
-	char* infile = "C:\\Users\\Administrator\\Desktop\\debug\\Result\\ϰƽ\\ȫЭ軰.wav";
-	char* outfile = "C:\\Users\\Administrator\\Desktop\\debug\\Result\\ϰƽ\\ȫЭ軰_new.wav";
+	int nthreads = 0;
+	const char* report = NULL;
+	int i;
+
+	/* energy kernel chosen once, before any thread starts */
+	sig_pcm16_kernel(SPRO_KERNEL_AUTO);
+
+	if (argc == 3 && argv[1][0] != '-')
+		return MergeWav(argv[1], argv[2]) ? 1 : 0;
+
+	if (argc == 4 && strcmp(argv[1], "-s") == 0)
+		return MergeWavStream(argv[2], argv[3]) ? 1 : 0;
+
+	if (argc == 4 && strcmp(argv[1], "-o") == 0)
+		return MergeWavOnline(argv[2], argv[3]) ? 1 : 0;
+
+	if (argc >= 3 && strcmp(argv[1], "-b") == 0) {
+		for (i = 3; i + 1 < argc; i += 2) {
+			if (strcmp(argv[i], "-j") == 0)
+				nthreads = atoi(argv[i + 1]);
+			else if (strcmp(argv[i], "-r") == 0)
+				report = argv[i + 1];
+			else
+				break;
+		}
+		if (i == argc)
+			return MergeWavBatch(argv[2], nthreads, report) ? 1 : 0;
+	}
+
+	if ((argc == 3 || (argc == 5 && strcmp(argv[3], "-r") == 0)) && strcmp(argv[1], "-t") == 0)
+		return MergeWavBench(argv[2], (argc == 5) ? argv[4] : NULL) ? 1 : 0;
+
+	if (argc == 2 && strcmp(argv[1], "-c") == 0)
+		return MergeWavCheck() ? 1 : 0;
 
-	MergeWav(infile, outfile);
+	fprintf(stderr, "usage: MergeWav input.wav output.wav\n");
+	fprintf(stderr, "       MergeWav -s input.wav output.wav\n");
+	fprintf(stderr, "       MergeWav -o input.wav|- output.wav|-\n");
+	fprintf(stderr, "       MergeWav -b manifest [-j threads] [-r report]\n");
+	fprintf(stderr, "       MergeWav -t benchmark [-r report]\n");
+	fprintf(stderr, "       MergeWav -c\n");
+	return 2;
 }
\ No newline at end of file
@@ -0,0 +1,376 @@
+/******************************************************************************/
+/*                                                                            */
+/*                                  batch.c                                   */
+/*                                                                            */
+/*****************************************************************************
+ * Batch processing of a manifest of wave files over a pool of threads.
+ *
+ * The manifest has one file per line according to the syntax
+ *
+ *   input output [minlen=<s>] [threshold=<v>] [channel=<n>] [stream=<0|1>]
+ *                [threads=<n>] [bins=<n>] [warmup=<s>] [lookahead=<s>]
+ *                [halflife=<s>] [gap=<ms>] [gapmode=<silence|noise|crossfade>]
+ *                [stats=<file>] [# comment]
+ *
+ * where file names containing blanks are double quoted and the
+ * optional key=value fields override the default processing options
+ * for that file only (channel=0 detects on the mean of all channels,
+ * all channels being merged whatever the one analysed; gap= sets the
+ * length of the silence, comfort noise or crossfade between segments;
+ * stats= appends the I/O counters and stage times of that file to a
+ * file of JSON lines, see mwstats.c).
+ * Empty lines and comment lines are allowed, a # within double quotes
+ * being part of a file name. Lines are at most 4094 characters long.
+ * Unless set by threads=, the processors are shared evenly between
+ * the files processed at the same time for the energy profile.
+ *
+ * Files are handed out to the worker threads in manifest order. A
+ * failure (bad manifest line, unreadable or unsupported input, write
+ * error) only affects the file concerned. Once all the files have
+ * been processed, a report with one line per file
+ *
+ *   status seconds input output
+ *
+ * followed by a summary comment line is written out.
+ */
+
+#include "MergeWav.h"
+#include "mthread.h"
+
+#define MAX_LINE_LEN 4096       /* maximum line length in a manifest          */
+#define COMMENT_CHAR '#'        /* comment character in a manifest            */
+
+#define BATCH_BAD_LINE -2       /* job status: invalid manifest entry         */
+#define BATCH_NOT_RUN -1        /* job status: not processed (yet)            */
+
+typedef struct {
+  char *in;                     /* input file name                            */
+  char *out;                    /* output file name                           */
+  mergeopt_t opt;               /* processing options                         */
+  int lino;                     /* manifest line number                       */
+  int status;                   /* MergeWavOpt() return value                 */
+  double secs;                  /* processing time                            */
+  char *stats;                  /* counters file name, or NULL                */
+  mwstats_t st;                 /* counters, if requested                     */
+} batchjob_t;
+
+typedef struct {
+  batchjob_t *job;              /* jobs in manifest order                     */
+  int n;                        /* number of jobs                             */
+  int next;                     /* next job to hand out                       */
+  mmutex_t lock;                /* protects next                              */
+} batch_t;
+
+/* --------------------------------------------------- */
+/* ----- static char *next_token(char **, int *) ----- */
+/* --------------------------------------------------- */
+/*
+ * Return the next blank separated, possibly double quoted, token of
+ * the line and advance *p past it. Return NULL at the end of the line
+ * or at a comment character out of quotes, and set *err on an
+ * unterminated quote.
+ */
+static char *next_token(char **p, int *err)
+{
+  char *c = *p, *tok;
+
+  while (*c && ISSPACE(*c))
+    c++;
+
+  if (! *c || *c == COMMENT_CHAR)
+    return(NULL);
+
+  if (*c == '"') {
+    tok = ++c;
+    while (*c && *c != '"')
+      c++;
+    if (! *c) {
+      *err = 1;
+      return(NULL);
+    }
+  }
+  else {
+    tok = c;
+    while (*c && ! ISSPACE(*c) && *c != COMMENT_CHAR)
+      c++;
+  }
+
+  if (*c == COMMENT_CHAR)
+    *c = 0x00;
+  else if (*c)
+    *c++ = 0x00;
+  *p = c;
+
+  return(tok);
+}
+
+/* --------------------------------------------------------- */
+/* ----- static int parse_option(mergeopt_t *, char *) ----- */
+/* --------------------------------------------------------- */
+/*
+ * Parse a key=value override. Return 0 if ok.
+ */
+static int parse_option(mergeopt_t *opt, char *tok)
+{
+  char *v, *end;
+
+  if ((v = strchr(tok, '=')) == NULL)
+    return(1);
+  *v++ = 0x00;
+
+  if (strcmp(tok, "minlen") == 0)
+    opt->minlen = (float)strtod(v, &end);
+  else if (strcmp(tok, "threshold") == 0)
+    opt->threshold = (float)strtod(v, &end);
+  else if (strcmp(tok, "channel") == 0)
+    opt->channel = (int)strtol(v, &end, 10);
+  else if (strcmp(tok, "stream") == 0)
+    opt->stream = (int)strtol(v, &end, 10);
+  else if (strcmp(tok, "threads") == 0)
+    opt->nthreads = (int)strtol(v, &end, 10);
+  else if (strcmp(tok, "bins") == 0)
+    opt->nbins = strtoul(v, &end, 10);
+  else if (strcmp(tok, "warmup") == 0)
+    opt->warmup = (float)strtod(v, &end);
+  else if (strcmp(tok, "lookahead") == 0)
+    opt->lookahead = (float)strtod(v, &end);
+  else if (strcmp(tok, "halflife") == 0)
+    opt->halflife = (float)strtod(v, &end);
+  else if (strcmp(tok, "gap") == 0)
+    opt->gap = (float)strtod(v, &end);
+  else if (strcmp(tok, "gapmode") == 0) {
+    end = v + strlen(v);
+    if (strcmp(v, "silence") == 0)
+      opt->gapmode = WAVOUT_SILENCE;
+    else if (strcmp(v, "noise") == 0)
+      opt->gapmode = WAVOUT_NOISE;
+    else if (strcmp(v, "crossfade") == 0)
+      opt->gapmode = WAVOUT_CROSSFADE;
+    else
+      return(1);
+  }
+  else
+    return(1);
+
+  return(end == v || *end || opt->minlen < 0.0 || opt->channel < 0 ||
+	 opt->warmup < 0.0 || opt->lookahead < 0.0 || opt->halflife < 0.0 || opt->gap < 0.0);
+}
+
+/* ---------------------------------------------------------- */
+/* ----- static int batch_read(batch_t *, const char *) ----- */
+/* ---------------------------------------------------------- */
+/*
+ * Read the manifest. Return 0 if ok.
+ */
+static int batch_read(batch_t *b, const char *fn)
+{
+  char line[MAX_LINE_LEN];
+  FILE *f;
+  char *p, *in, *out, *tok;
+  batchjob_t *job;
+  int lino = 0, m = 0, err;
+
+  if ((f = fopen(fn, "r")) == NULL) {
+    fprintf(stderr, "MergeWavBatch: cannot open manifest %s\n", fn);
+    return(1);
+  }
+
+  b->job = NULL;
+  b->n = 0;
+
+  while (fgets(line, MAX_LINE_LEN, f) != NULL) {
+
+    lino++;
+    err = 0;
+
+    /* the rest of a too long line would be read as another entry */
+    if (strchr(line, '\n') == NULL && ! feof(f)) {
+      fprintf(stderr, "MergeWavBatch: line %d of %s longer than %d characters\n", lino, fn, MAX_LINE_LEN - 2);
+      while (fgets(line, MAX_LINE_LEN, f) != NULL && strchr(line, '\n') == NULL)
+	;
+      line[0] = 0x00;
+      err = 1;
+    }
+
+    p = line;
+    if ((in = next_token(&p, &err)) == NULL && ! err)
+      continue;
+
+    if (b->n == m) {
+      m = (m) ? (2 * m) : (256);
+      if ((job = (batchjob_t *)realloc(b->job, m * sizeof(batchjob_t))) == NULL) {
+	fprintf(stderr, "MergeWavBatch: cannot allocate memory\n");
+	fclose(f);
+	return(1);
+      }
+      b->job = job;
+    }
+
+    job = b->job + b->n;
+    mergeopt_init(&(job->opt));
+    job->lino = lino;
+    job->status = BATCH_NOT_RUN;
+    job->secs = 0.0;
+    job->in = job->out = job->stats = NULL;
+    mwstats_init(&(job->st));
+
+    out = (in) ? next_token(&p, &err) : NULL;
+    if (in && out) {
+      while ((tok = next_token(&p, &err)) != NULL) {
+	if (strncmp(tok, "stats=", 6) == 0 && tok[6]) {
+	  free(job->stats);
+	  if ((job->stats = strdup(tok + 6)) == NULL)
+	    err = 1;
+	}
+	else if (parse_option(&(job->opt), tok))
+	  err = 1;
+      }
+    }
+    else
+      err = 1;
+
+    if (in)
+      job->in = strdup(in);
+    if (out)
+      job->out = strdup(out);
+    if (err || job->in == NULL || job->out == NULL) {
+      fprintf(stderr, "MergeWavBatch: invalid entry at line %d of %s\n", lino, fn);
+      job->status = BATCH_BAD_LINE;
+    }
+
+    b->n++;
+  }
+
+  fclose(f);
+
+  return(0);
+}
+
+/* -------------------------------------------- */
+/* ----- static void batch_worker(void *) ----- */
+/* -------------------------------------------- */
+/*
+ * Process jobs until there are none left.
+ */
+static void batch_worker(void *arg)
+{
+  batch_t *b = (batch_t *)arg;
+  batchjob_t *job;
+  double t;
+  int i;
+
+  while (1) {
+    mmutex_lock(&(b->lock));
+    i = b->next++;
+    mmutex_unlock(&(b->lock));
+
+    if (i >= b->n)
+      break;
+
+    job = b->job + i;
+    if (job->status == BATCH_BAD_LINE)
+      continue;
+
+    /* the job array does not move any more */
+    if (job->stats)
+      job->opt.stats = &(job->st);
+
+    t = mthread_clock();
+    job->status = MergeWavOpt(job->in, job->out, &(job->opt));
+    job->secs = mthread_clock() - t;
+
+    if (job->status)
+      fprintf(stderr, "MergeWavBatch: failed to process %s (line %d)\n", job->in, job->lino);
+  }
+}
+
+/* -------------------------------------------------------------- */
+/* ----- int MergeWavBatch(const char *, int, const char *) ----- */
+/* -------------------------------------------------------------- */
+/*
+ * Process all the files of a manifest with nthreads worker threads (as
+ * many as processors if nthreads <= 0) and write the report to the
+ * file report (stdout if NULL). Return the number of failed files or
+ * -1 if the manifest cannot be processed at all.
+ */
+int MergeWavBatch(const char* manifest, int nthreads, const char* report)
+{
+  batch_t b;
+  mthread_t *tid;
+  FILE *f;
+  double t;
+  int i, ncpu, nstarted, nfailed = 0;
+
+  if (batch_read(&b, manifest))
+    return(-1);
+
+  ncpu = mthread_ncpu();
+  if (nthreads <= 0)
+    nthreads = ncpu;
+  if (nthreads > b.n)
+    nthreads = (b.n) ? (b.n) : (1);
+
+  for (i = 0; i < b.n; i++)
+    if (b.job[i].opt.nthreads <= 0)
+      b.job[i].opt.nthreads = (ncpu > nthreads) ? (ncpu / nthreads) : (1);
+
+  if ((tid = (mthread_t *)malloc(nthreads * sizeof(mthread_t))) == NULL) {
+    fprintf(stderr, "MergeWavBatch: cannot allocate memory\n");
+    nstarted = 0;
+    t = 0.0;
+  }
+  else {
+    b.next = 0;
+    mmutex_init(&(b.lock));
+
+    t = mthread_clock();
+    for (nstarted = 0; nstarted < nthreads; nstarted++)
+      if (mthread_create(tid + nstarted, batch_worker, &b))
+	break;
+
+    /* no thread at all: do the work ourselves */
+    if (nstarted == 0)
+      batch_worker(&b);
+
+    for (i = 0; i < nstarted; i++)
+      mthread_join(tid[i]);
+    t = mthread_clock() - t;
+
+    mmutex_destroy(&(b.lock));
+    free(tid);
+  }
+
+  /* ----- report ----- */
+  if (report == NULL || strcmp(report, "-") == 0)
+    f = stdout;
+  else if ((f = fopen(report, "w")) == NULL) {
+    fprintf(stderr, "MergeWavBatch: cannot open report file %s, using stdout\n", report);
+    f = stdout;
+  }
+
+  fprintf(f, "# status\tseconds\tinput\toutput\n");
+  for (i = 0; i < b.n; i++) {
+    if (b.job[i].status)
+      nfailed++;
+    fprintf(f, "%s\t%.3f\t%s\t%s\n", (b.job[i].status == 0) ? "ok" : (b.job[i].status == BATCH_BAD_LINE) ? "invalid" : "failed",
+	    b.job[i].secs, (b.job[i].in) ? (b.job[i].in) : "-", (b.job[i].out) ? (b.job[i].out) : "-");
+  }
+  fprintf(f, "# files=%d ok=%d failed=%d threads=%d seconds=%.3f\n", b.n, b.n - nfailed, nfailed, (nstarted) ? (nstarted) : (1), t);
+
+  if (f != stdout)
+    fclose(f);
+
+  /* counters in manifest order, whatever the order of completion */
+  for (i = 0; i < b.n; i++)
+    if (b.job[i].stats && b.job[i].status != BATCH_BAD_LINE && b.job[i].status != BATCH_NOT_RUN)
+      mwstats_write(&(b.job[i].st), b.job[i].in, b.job[i].stats);
+
+  for (i = 0; i < b.n; i++) {
+    free(b.job[i].in);
+    free(b.job[i].out);
+    free(b.job[i].stats);
+  }
+  free(b.job);
+
+  return(nfailed);
+}
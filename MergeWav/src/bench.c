@@ -0,0 +1,500 @@
+/******************************************************************************/
+/*                                                                            */
+/*                                  bench.c                                   */
+/*                                                                            */
+/*****************************************************************************
+ * End to end benchmark on synthetic corpora.
+ *
+ * The benchmark specification has one corpus per line according to
+ * the syntax
+ *
+ *   input output [duration=<s>] [speech=<ratio>] [segments=<n>]
+ *                [noise=<dB>] [rate=<Hz>] [bits=<n>] [channels=<n>]
+ *                [seed=<n>] [bins=<n>] [threads=<n>] [# comment]
+ *
+ * where file names contain no blanks. The input wave file is (re)
+ * generated from the key=value fields: duration seconds of which a
+ * speech ratio is split into segments speech segments, with random
+ * lengths and positions. Speech is a harmonic signal with a syllabic
+ * modulation at BENCH_SPEECH_DB and the whole signal has white noise at
+ * noise dB full scale. Random draws come from a fixed generator
+ * started at seed, so that a line always gives the same corpus. bins=
+ * and threads= are the detector options of the batch manifest.
+ *
+ * Each corpus is then merged into output by MergeWavOpt(), the very
+ * path of the other modes, whose stage counters (see mwstats.c) give
+ * the time of each step: stream opening, energy profile, bi-gaussian
+ * EM (exact or histogram), segmentation, segment and gap writes, and
+ * the final header. Corpora are processed one after the other, so
+ * that the profile threads are the only ones running.
+ *
+ * The report is tab separated, one line per corpus, with the time of
+ * each step in seconds, the throughput in hours of audio and in MB of
+ * input per second of the whole merge, and the peak resident memory of
+ * the process so far. With bins=, the histogram EM is also compared to
+ * the exact one on the same profile, outside of the timed merge: the
+ * largest relative deltas of the gaussian means and variances, and the
+ * fraction of the samples on which both segmentations agree ("-"
+ * without bins=).
+ */
+
+#define _bench_c_
+
+#include "MergeWav.h"
+#include "mthread.h"
+
+#ifdef _WIN32
+# include <psapi.h>
+# ifdef _MSC_VER
+#  pragma comment(lib, "psapi.lib")
+# endif
+#else
+# include <sys/resource.h>
+#endif
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+#define MAX_LINE_LEN 4096       /* maximum line length in a specification     */
+#define COMMENT_CHAR '#'        /* comment character in a specification       */
+
+#define BENCH_SPEECH_DB -20.0   /* speech RMS level (dB full scale)           */
+#define BENCH_BLOCK 4096        /* generation block (num. sample frames)      */
+
+typedef struct {
+  float duration;               /* corpus length in s (600)                   */
+  float speech;                 /* speech ratio (0.6)                         */
+  unsigned long nseg;           /* number of speech segments (60)             */
+  float noise;                  /* noise floor in dB full scale (-60)         */
+  head_pama fmt;                /* 16 kHz, 16 bits, mono                      */
+  unsigned long seed;           /* random generator seed (1)                  */
+  unsigned long nbins;          /* histogram EM bins, 0 for exact EM (0)      */
+  int nthreads;                 /* profile threads, 0 for one per CPU (0)     */
+} benchspec_t;
+
+/* step times, in seconds */
+#define BENCH_GEN 0             /* corpus generation (not part of the merge)  */
+#define BENCH_OPEN 1            /* MWSTATS_OPEN stage of MergeWavOpt()        */
+#define BENCH_PROFILE 2         /* MWSTATS_PROFILE                            */
+#define BENCH_EM 3              /* MWSTATS_EM                                 */
+#define BENCH_SEG 4             /* MWSTATS_SEG                                */
+#define BENCH_WRITE 5           /* MWSTATS_WRITE                              */
+#define BENCH_HEADER 6          /* MWSTATS_HEADER                             */
+#define BENCH_NSTEPS 7
+
+/* ----------------------------------------------------- */
+/* ----- static double bench_rand(unsigned long *) ----- */
+/* ----------------------------------------------------- */
+/*
+ * Uniform draw in [0,1) from a 32 bits linear congruential generator.
+ */
+static double bench_rand(unsigned long *x)
+{
+  *x = (*x * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+
+  return((double)(*x >> 8) / 16777216.0);
+}
+
+/* ------------------------------------------------------ */
+/* ----- static double bench_gauss(unsigned long *) ----- */
+/* ------------------------------------------------------ */
+/*
+ * Zero mean, unit variance draw (sum of 4 uniform draws).
+ */
+static double bench_gauss(unsigned long *x)
+{
+  double u = -2.0;
+  int k;
+
+  for (k = 0; k < 4; k++)
+    u += bench_rand(x);
+
+  return(u * sqrt(3.0));
+}
+
+/* -------------------------------------- */
+/* ----- static long peak_rss(void) ----- */
+/* -------------------------------------- */
+/*
+ * Peak resident memory of the process in kB, or -1 if unknown.
+ */
+static long peak_rss(void)
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS pmc;
+
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return((long)(pmc.PeakWorkingSetSize / 1024));
+#else
+  struct rusage ru;
+
+  if (getrusage(RUSAGE_SELF, &ru) == 0)
+# ifdef __APPLE__
+    return((long)(ru.ru_maxrss / 1024));
+# else
+    return((long)ru.ru_maxrss);
+# endif
+#endif
+
+  return(-1);
+}
+
+/* ---------------------------------------------------------------- */
+/* ----- static int bench_corpus(const char *, benchspec_t *) ----- */
+/* ---------------------------------------------------------------- */
+/*
+ * Generate the corpus of a specification into fn. Return 0 if ok.
+ */
+static int bench_corpus(const char *fn, benchspec_t *spec)
+{
+  FILE *f;
+  char *buf;
+  double *len, sum, t, v, f0 = 0.0, a, an, w;
+  unsigned long x = spec->seed, i, k, nlen = 2 * spec->nseg + 1;
+  aseg_pos_t n, pos, end;
+  int nbps = spec->fmt.bits / 8, bpf = nbps * spec->fmt.channels, h, c, status = 0;
+
+  /* lengths of the silences (even) and of the speech segments (odd) */
+  if ((len = (double *)malloc(nlen * sizeof(double))) == NULL || (buf = (char *)malloc((size_t)BENCH_BLOCK * bpf)) == NULL) {
+    fprintf(stderr, "MergeWavBench: cannot allocate memory\n");
+    free(len);
+    return(1);
+  }
+
+  for (k = 0; k < 2; k++) {
+    for (i = k, sum = 0.0; i < nlen; i += 2)
+      sum += (len[i] = 0.5 + bench_rand(&x));
+    w = spec->duration * ((k) ? (spec->speech) : (1.0 - spec->speech)) / sum;
+    for (i = k; i < nlen; i += 2)
+      len[i] *= w;
+  }
+
+  if ((f = fopen(fn, "wb")) == NULL) {
+    fprintf(stderr, "MergeWavBench: cannot open %s\n", fn);
+    free(len); free(buf);
+    return(1);
+  }
+
+  n = (aseg_pos_t)((double)spec->duration * spec->fmt.rate);
+  spec->fmt.datasize = (long long)n;
+  spec->fmt.layout = WAV_LAYOUT_AUTO;
+  wav_write_header(f, spec->fmt);
+
+  /* harmonics 1 to 5 in 1/h, of RMS 0.855, modulated at 4 Hz (RMS 0.663) */
+  a = pow(10.0, BENCH_SPEECH_DB / 20.0) * ldexp(1.0, 8 * nbps - 1) / (0.855 * 0.663);
+  an = pow(10.0, spec->noise / 20.0) * ldexp(1.0, 8 * nbps - 1);
+
+  for (pos = 0, i = 0, end = 0; pos < n && status == 0; ) {
+
+    for (k = 0; k < BENCH_BLOCK && pos < n; k++, pos++) {
+      while (pos >= end && i < nlen) {
+	end += (aseg_pos_t)(len[i++] * spec->fmt.rate);
+	f0 = 100.0 + 100.0 * bench_rand(&x);
+      }
+      t = (double)pos / spec->fmt.rate;
+      v = an * bench_gauss(&x);
+      if ((i & 1) == 0 && pos < end) /* in a speech segment */
+	for (h = 1, w = a * (0.6 + 0.4 * sin(2.0 * M_PI * 4.0 * t)); h <= 5; h++)
+	  v += w * sin(2.0 * M_PI * h * f0 * t) / h;
+      for (c = 0; c < spec->fmt.channels; c++)
+	putsample(buf, k * spec->fmt.channels + c, nbps, v);
+    }
+
+    if (fwrite(buf, bpf, k, f) != k) {
+      fprintf(stderr, "MergeWavBench: cannot write %s\n", fn);
+      status = 1;
+    }
+  }
+
+  if (fclose(f) != 0)
+    status = 1;
+  free(len);
+  free(buf);
+
+  return(status);
+}
+
+/* -------------------------------------------------------- */
+/* ----- static int parse_spec(benchspec_t *, char *) ----- */
+/* -------------------------------------------------------- */
+/*
+ * Parse a key=value field of a specification line. Return 0 if ok.
+ */
+static int parse_spec(benchspec_t *spec, char *tok)
+{
+  char *v, *end;
+
+  if ((v = strchr(tok, '=')) == NULL)
+    return(1);
+  *v++ = 0x00;
+
+  if (strcmp(tok, "duration") == 0)
+    spec->duration = (float)strtod(v, &end);
+  else if (strcmp(tok, "speech") == 0)
+    spec->speech = (float)strtod(v, &end);
+  else if (strcmp(tok, "segments") == 0)
+    spec->nseg = strtoul(v, &end, 10);
+  else if (strcmp(tok, "noise") == 0)
+    spec->noise = (float)strtod(v, &end);
+  else if (strcmp(tok, "rate") == 0)
+    spec->fmt.rate = (int)strtol(v, &end, 10);
+  else if (strcmp(tok, "bits") == 0)
+    spec->fmt.bits = (short)strtol(v, &end, 10);
+  else if (strcmp(tok, "channels") == 0)
+    spec->fmt.channels = (short)strtol(v, &end, 10);
+  else if (strcmp(tok, "seed") == 0)
+    spec->seed = strtoul(v, &end, 10);
+  else if (strcmp(tok, "bins") == 0)
+    spec->nbins = strtoul(v, &end, 10);
+  else if (strcmp(tok, "threads") == 0)
+    spec->nthreads = (int)strtol(v, &end, 10);
+  else
+    return(1);
+
+  return(end == v || *end || spec->duration <= 0.0 || spec->speech < 0.0 || spec->speech > 1.0 ||
+	 spec->nseg == 0 || ! wav_format_supported(spec->fmt));
+}
+
+/* ----------------------------------------------------------------------------- */
+/* ----- static int bench_merge(const char *, const char *, benchspec_t *, ----- */
+/* -----                       double *, unsigned long *)                  ----- */
+/* ----------------------------------------------------------------------------- */
+/*
+ * Merge input into output with MergeWavOpt(), reading the time of each
+ * step into secs from its stage counters. Return 0 if ok.
+ */
+static int bench_merge(const char *in, const char *out, benchspec_t *spec, double *secs, unsigned long *nseg)
+{
+  mergeopt_t opt;
+  mwstats_t st;
+  int status;
+
+  mergeopt_init(&opt);
+  opt.nthreads = spec->nthreads;
+  opt.nbins = spec->nbins;
+  mwstats_init(&st);
+  opt.stats = &st;
+
+  status = MergeWavOpt(in, out, &opt);
+
+  secs[BENCH_OPEN] = st.t[MWSTATS_OPEN];
+  secs[BENCH_PROFILE] = st.t[MWSTATS_PROFILE];
+  secs[BENCH_EM] = st.t[MWSTATS_EM];
+  secs[BENCH_SEG] = st.t[MWSTATS_SEG];
+  secs[BENCH_WRITE] = st.t[MWSTATS_WRITE];
+  secs[BENCH_HEADER] = st.t[MWSTATS_HEADER];
+  *nseg = st.nseg;
+
+  return(status);
+}
+
+/* ----------------------------------------------------------------------------- */
+/* ----- static aseg_pos_t seg_overlap(const segtab_t *, const segtab_t *) ----- */
+/* ----------------------------------------------------------------------------- */
+/*
+ * Number of samples within a segment of both sorted segment tables.
+ */
+static aseg_pos_t seg_overlap(const segtab_t *a, const segtab_t *b)
+{
+  aseg_pos_t n = 0, st, et;
+  unsigned long i = 0, j = 0;
+
+  while (i < a->n && j < b->n) {
+    st = (a->seg[i].st > b->seg[j].st) ? (a->seg[i].st) : (b->seg[j].st);
+    et = (a->seg[i].et < b->seg[j].et) ? (a->seg[i].et) : (b->seg[j].et);
+    if (st < et)
+      n += et - st;
+    if (a->seg[i].et < b->seg[j].et)
+      i++;
+    else
+      j++;
+  }
+
+  return(n);
+}
+
+/* ---------------------------------------------------------------------------- */
+/* ----- static int bench_accuracy(const char *, benchspec_t *, double *) ----- */
+/* ---------------------------------------------------------------------------- */
+/*
+ * Compare the histogram EM of spec->nbins bins with the exact EM, both
+ * started from the same model on the energy profile of input: largest
+ * relative change of the gaussian means (acc[0]) and variances
+ * (acc[1]), and fraction of the samples labelled alike by the
+ * segmentations of both models (acc[2]). Return 0 if ok.
+ */
+static int bench_accuracy(const char *in, benchspec_t *spec, double *acc)
+{
+  sigstream_t *s;
+  ssad_ctx_t ctx;
+  spfbuf_t *e;
+  bigauss_t bx, bh;
+  bigauss_hist_t *h;
+  segtab_t *tx = NULL, *th = NULL;
+  aseg_pos_t nx = 0, nh = 0;
+  unsigned short nl, nd;
+  unsigned long i;
+  double emin, emax, d;
+  int k, status = 1;
+
+  ssad_ctx_init(&ctx);
+  ctx.nthreads = spec->nthreads;
+
+  if ((s = sig_stream_open(in, SPRO_SIG_MMAP_FORMAT, 0.0, 10000000, 0)) == NULL &&
+      (s = sig_stream_open(in, SPRO_SIG_WAVE_FORMAT, 0.0, 10000000, 0)) == NULL) {
+    fprintf(stderr, "MergeWavBench: cannot open input signal stream %s\n", in);
+    return(1);
+  }
+
+  nl = (unsigned short)(ctx.fm_l * s->Fs / 1000.0);
+  nd = (unsigned short)(ctx.fm_d * s->Fs / 1000.0);
+
+  if ((e = get_energy_profile(&ctx, s, nl, nd, &emin, &emax)) == NULL) {
+    sig_stream_close(s);
+    return(1);
+  }
+
+  init_bigauss(&bx, emin, emax);
+  bh = bx;
+  buf_to_bigauss(e, &bx, 20, 0.0001, ctx.nthreads);
+  if ((h = bigauss_hist(e, emin, emax, spec->nbins)) != NULL) {
+    hist_to_bigauss(h, &bh, 20, 0.0001);
+    bigauss_hist_free(h);
+
+    if ((tx = seg_tab_alloc(s->Fs)) != NULL && (th = seg_tab_alloc(s->Fs)) != NULL &&
+	profile_to_seg(&ctx, e, &bx, nd, s->Fs, tx) == 0 && profile_to_seg(&ctx, e, &bh, nd, s->Fs, th) == 0)
+      status = 0;
+    else
+      fprintf(stderr, "MergeWavBench: cannot create output segmentation\n");
+  }
+
+  if (status == 0) {
+    for (k = 0, acc[0] = acc[1] = 0.0; k < 2; k++) {
+      if ((d = fabs((bh.m[k] - bx.m[k]) / bx.m[k])) > acc[0])
+	acc[0] = d;
+      if ((d = fabs(bx.v[k] / bh.v[k] - 1.0)) > acc[1]) /* v is the inverse variance */
+	acc[1] = d;
+    }
+    for (i = 0; i < tx->n; i++)
+      nx += tx->seg[i].et - tx->seg[i].st;
+    for (i = 0; i < th->n; i++)
+      nh += th->seg[i].et - th->seg[i].st;
+    acc[2] = (s->nsamples) ? (1.0 - (double)(nx + nh - 2 * seg_overlap(tx, th)) / (double)s->nsamples) : (1.0);
+  }
+
+  seg_tab_free(tx);
+  seg_tab_free(th);
+  spf_buf_free(e);
+  sig_stream_close(s);
+
+  return(status);
+}
+
+/* --------------------------------------------------------- */
+/* ----- int MergeWavBench(const char *, const char *) ----- */
+/* --------------------------------------------------------- */
+/*
+ * Generate and merge the corpora of a benchmark specification, writing
+ * the report to the file report (stdout if NULL). Return the number of
+ * failed corpora or -1 if the specification cannot be read at all.
+ */
+int MergeWavBench(const char* specfile, const char* report)
+{
+  char line[MAX_LINE_LEN];
+  FILE *f, *rf;
+  char *p, *in, *out, *tok;
+  benchspec_t spec;
+  double secs[BENCH_NSTEPS], acc[3], t, hours, mb;
+  unsigned long nseg;
+  int lino = 0, nfailed = 0, err, k;
+  const char *status;
+
+  if ((f = fopen(specfile, "r")) == NULL) {
+    fprintf(stderr, "MergeWavBench: cannot open specification %s\n", specfile);
+    return(-1);
+  }
+
+  if (report == NULL || strcmp(report, "-") == 0)
+    rf = stdout;
+  else if ((rf = fopen(report, "w")) == NULL) {
+    fprintf(stderr, "MergeWavBench: cannot open report file %s, using stdout\n", report);
+    rf = stdout;
+  }
+
+  fprintf(rf, "# status\tinput\thours\tMB\tsegments\tgenerate\topen\tprofile\tem\tseg\twrite\theader\tseconds\thours/s\tMB/s\tpeak_rss_kB\tmean_delta\tvar_delta\tagreement\n");
+
+  while (fgets(line, MAX_LINE_LEN, f) != NULL) {
+
+    lino++;
+
+    if ((p = strchr(line, COMMENT_CHAR)) != NULL)
+      *p = 0x00;
+
+    if ((in = strtok(line, " \t\r\n")) == NULL)
+      continue;
+    out = strtok(NULL, " \t\r\n");
+
+    spec.duration = 600.0;
+    spec.speech = 0.6;
+    spec.nseg = 60;
+    spec.noise = -60.0;
+    spec.fmt.rate = 16000;
+    spec.fmt.bits = 16;
+    spec.fmt.channels = 1;
+    spec.fmt.dataoff = 0;
+    spec.seed = 1;
+    spec.nbins = 0;
+    spec.nthreads = 0;
+
+    for (err = (out == NULL); ! err && (tok = strtok(NULL, " \t\r\n")) != NULL; )
+      err = parse_spec(&spec, tok);
+
+    for (k = 0; k < BENCH_NSTEPS; k++)
+      secs[k] = 0.0;
+    acc[0] = acc[1] = acc[2] = 0.0;
+    nseg = 0;
+
+    if (err) {
+      fprintf(stderr, "MergeWavBench: invalid entry at line %d of %s\n", lino, specfile);
+      status = "invalid";
+    }
+    else {
+      t = mthread_clock();
+      err = bench_corpus(in, &spec);
+      secs[BENCH_GEN] = mthread_clock() - t;
+      if (err || bench_merge(in, out, &spec, secs, &nseg) || (spec.nbins && bench_accuracy(in, &spec, acc))) {
+	fprintf(stderr, "MergeWavBench: failed to process %s (line %d)\n", in, lino);
+	err = 1;
+      }
+      status = (err) ? "failed" : "ok";
+    }
+
+    if (err)
+      nfailed++;
+
+    /* ----- one report line, the merge time excluding generation ----- */
+    hours = (err) ? (0.0) : (spec.duration / 3600.0);
+    mb = (err) ? (0.0) : ((double)spec.fmt.datasize * (spec.fmt.bits / 8) * spec.fmt.channels / 1e6);
+    for (k = BENCH_OPEN, t = 0.0; k < BENCH_NSTEPS; k++)
+      t += secs[k];
+
+    fprintf(rf, "%s\t%s\t%.6f\t%.3f\t%lu", status, in, hours, mb, nseg);
+    for (k = 0; k < BENCH_NSTEPS; k++)
+      fprintf(rf, "\t%.6f", secs[k]);
+    fprintf(rf, "\t%.6f\t%.3f\t%.3f\t%ld", t, (t > 0.0) ? (hours / t) : (0.0), (t > 0.0) ? (mb / t) : (0.0), peak_rss());
+    if (err || spec.nbins == 0)
+      fprintf(rf, "\t-\t-\t-\n");
+    else
+      fprintf(rf, "\t%.3e\t%.3e\t%.6f\n", acc[0], acc[1], acc[2]);
+    fflush(rf);
+  }
+
+  fclose(f);
+  if (rf != stdout)
+    fclose(rf);
+
+  return(nfailed);
+}
+
+#undef _bench_c_
@@ -0,0 +1,459 @@
+/******************************************************************************/
+/*                                                                            */
+/*                                 bigauss.c                                  */
+/*                                                                            */
+/*****************************************************************************
+ * Hard assignment statistics for the bi-gaussian EM.
+ *
+ * Each EM iteration of buf_to_bigauss() assigns every frame energy to
+ * the most likely gaussian and accumulates, per gaussian, the number of
+ * frames, the sum and the sum of squares of the energies, plus the
+ * total log-likelihood. The assignment is done here without branches,
+ * on 4 lanes of doubles: AVX2, two SSE2 registers or plain C
+ * depending on the processor, as selected by sig_pcm16_kernel() for
+ * all the SIMD kernels and read once per bigauss_stats() call.
+ *
+ * The log-likelihoods are computed with exactly the same operations
+ * as before, so that every frame gets the same gaussian. Only the
+ * order of the accumulations changes: lane j of a block sums frames
+ * j, j+4, j+8... of the block, the lanes are added as (0+1)+(2+3) and
+ * blocks of BIGAUSS_BLOCK frames are added in order. This order does
+ * not depend on the kernel nor on the number of threads, so that the
+ * model is reproducible from one machine to the other; it only differs
+ * from the former sequential sums by double precision rounding.
+ *
+ * Long profiles are split by blocks over several threads, each block
+ * having its own partial sums which are reduced afterwards.
+ *
+ * For huge profiles, the EM can also run on a histogram of the
+ * features, built once, whose bins keep the exact count, sum and sum
+ * of squares of their features. Bins are assigned as a whole, which
+ * makes each iteration O(bins) instead of O(frames) at the price of
+ * approximating the decision boundary to one bin width.
+ */
+
+#define _bigauss_c_
+
+#include "ssad.h"
+#include "mthread.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+# define BIGAUSS_X86 1
+# define BIGAUSS_TARGET(isa)
+# include <immintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+# define BIGAUSS_X86 1
+# define BIGAUSS_TARGET(isa) __attribute__((target(isa)))
+# include <immintrin.h>
+#endif
+
+#define BIGAUSS_LANES 4           /* accumulation lanes                       */
+#define BIGAUSS_BLOCK 8192        /* frames per partial sum                   */
+#define BIGAUSS_MT_MIN 16         /* minimum number of blocks per thread      */
+
+/* per frame log-likelihood terms: a * v - b * v * v + c */
+typedef struct {
+  double a[2];                    /* v * m                                    */
+  double b[2];                    /* 0.5 * v                                  */
+  double c[2];                    /* constant                                 */
+} bigauss_coef_t;
+
+/* partial sums, n1 being a count and n2 = n - n1 */
+typedef struct {
+  double n1, m1, m2, v1, v2, llk;
+} bigauss_sum_t;
+
+typedef struct {
+  const spf_t *e;                 /* energy profile                           */
+  unsigned long n;                /* number of frames                         */
+  const bigauss_coef_t *k;        /* model                                    */
+  bigauss_sum_t *sum;             /* one partial sum per block                */
+  unsigned long b0, b1;           /* blocks handled by the thread             */
+  int kernel;                     /* SIMD kernel level                        */
+} bigauss_job_t;
+
+/* ----------------------------------------------------------------------- */
+/* ----- static void block_c(const spf_t *, unsigned long,           ----- */
+/* -----                    const bigauss_coef_t *, bigauss_sum_t *) ----- */
+/* ----------------------------------------------------------------------- */
+/*
+ * Plain C kernel. Also used for the last n % 4 frames of a block by
+ * the SIMD kernels, with lanes starting at 0.
+ */
+static void block_c(const spf_t *e, unsigned long n, const bigauss_coef_t *k, bigauss_sum_t *s)
+{
+  unsigned long i;
+  double v, vv, llk1, llk2;
+  int j, sel;
+
+  for (i = 0; i < n; i++) {
+    j = (int)(i % BIGAUSS_LANES);
+    v = *(e+i);
+    vv = v * v;
+
+    llk1 = k->a[0] * v - k->b[0] * vv + k->c[0];
+    llk2 = k->a[1] * v - k->b[1] * vv + k->c[1];
+
+    sel = (llk1 > llk2);
+    s[j].n1 += sel;
+    s[j].m1 += (sel) ? (v) : (0.0);
+    s[j].v1 += (sel) ? (vv) : (0.0);
+    s[j].m2 += (sel) ? (0.0) : (v);
+    s[j].v2 += (sel) ? (0.0) : (vv);
+    s[j].llk += (sel) ? (llk1) : (llk2);
+  }
+}
+
+#ifdef BIGAUSS_X86
+/* assign and accumulate two lanes */
+BIGAUSS_TARGET("sse2")
+static void lanes_sse2(__m128d x, __m128d a1, __m128d b1, __m128d c1, __m128d a2, __m128d b2, __m128d c2, __m128d one, __m128d *acc)
+{
+  __m128d xx, l1, l2, sel;
+
+  xx = _mm_mul_pd(x, x);
+  l1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(a1, x), _mm_mul_pd(b1, xx)), c1);
+  l2 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(a2, x), _mm_mul_pd(b2, xx)), c2);
+  sel = _mm_cmpgt_pd(l1, l2);
+
+  acc[0] = _mm_add_pd(acc[0], _mm_and_pd(sel, one));
+  acc[1] = _mm_add_pd(acc[1], _mm_and_pd(sel, x));
+  acc[2] = _mm_add_pd(acc[2], _mm_andnot_pd(sel, x));
+  acc[3] = _mm_add_pd(acc[3], _mm_and_pd(sel, xx));
+  acc[4] = _mm_add_pd(acc[4], _mm_andnot_pd(sel, xx));
+  acc[5] = _mm_add_pd(acc[5], _mm_or_pd(_mm_and_pd(sel, l1), _mm_andnot_pd(sel, l2)));
+}
+
+/* -------------------------------------------------------------------------- */
+/* ----- static void block_sse2(const spf_t *, unsigned long,           ----- */
+/* -----                       const bigauss_coef_t *, bigauss_sum_t *) ----- */
+/* -------------------------------------------------------------------------- */
+BIGAUSS_TARGET("sse2")
+static void block_sse2(const spf_t *e, unsigned long n, const bigauss_coef_t *k, bigauss_sum_t *s)
+{
+  __m128d a1 = _mm_set1_pd(k->a[0]), b1 = _mm_set1_pd(k->b[0]), c1 = _mm_set1_pd(k->c[0]);
+  __m128d a2 = _mm_set1_pd(k->a[1]), b2 = _mm_set1_pd(k->b[1]), c2 = _mm_set1_pd(k->c[1]);
+  __m128d one = _mm_set1_pd(1.0);
+  __m128d lo[6], hi[6];           /* lanes 0-1 and 2-3                        */
+  double r[2];
+  __m128 x;
+  unsigned long i;
+  int q;
+
+  for (q = 0; q < 6; q++)
+    lo[q] = hi[q] = _mm_setzero_pd();
+
+  for (i = 0; i + BIGAUSS_LANES <= n; i += BIGAUSS_LANES) {
+    x = _mm_loadu_ps(e + i);
+    lanes_sse2(_mm_cvtps_pd(x), a1, b1, c1, a2, b2, c2, one, lo);
+    lanes_sse2(_mm_cvtps_pd(_mm_movehl_ps(x, x)), a1, b1, c1, a2, b2, c2, one, hi);
+  }
+
+#define BIGAUSS_STORE(q, f)			\
+  _mm_storeu_pd(r, lo[q]); s[0].f += r[0]; s[1].f += r[1];	\
+  _mm_storeu_pd(r, hi[q]); s[2].f += r[0]; s[3].f += r[1];
+  BIGAUSS_STORE(0, n1);
+  BIGAUSS_STORE(1, m1);
+  BIGAUSS_STORE(2, m2);
+  BIGAUSS_STORE(3, v1);
+  BIGAUSS_STORE(4, v2);
+  BIGAUSS_STORE(5, llk);
+#undef BIGAUSS_STORE
+
+  block_c(e + i, n - i, k, s);
+}
+
+/* -------------------------------------------------------------------------- */
+/* ----- static void block_avx2(const spf_t *, unsigned long,           ----- */
+/* -----                       const bigauss_coef_t *, bigauss_sum_t *) ----- */
+/* -------------------------------------------------------------------------- */
+BIGAUSS_TARGET("avx2")
+static void block_avx2(const spf_t *e, unsigned long n, const bigauss_coef_t *k, bigauss_sum_t *s)
+{
+  __m256d a1 = _mm256_set1_pd(k->a[0]), b1 = _mm256_set1_pd(k->b[0]), c1 = _mm256_set1_pd(k->c[0]);
+  __m256d a2 = _mm256_set1_pd(k->a[1]), b2 = _mm256_set1_pd(k->b[1]), c2 = _mm256_set1_pd(k->c[1]);
+  __m256d one = _mm256_set1_pd(1.0);
+  __m256d acc[6], x, xx, l1, l2, sel;
+  double r[4];
+  unsigned long i;
+  int q;
+
+  for (q = 0; q < 6; q++)
+    acc[q] = _mm256_setzero_pd();
+
+  for (i = 0; i + BIGAUSS_LANES <= n; i += BIGAUSS_LANES) {
+    x = _mm256_cvtps_pd(_mm_loadu_ps(e + i));
+    xx = _mm256_mul_pd(x, x);
+    l1 = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(a1, x), _mm256_mul_pd(b1, xx)), c1);
+    l2 = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(a2, x), _mm256_mul_pd(b2, xx)), c2);
+    sel = _mm256_cmp_pd(l1, l2, _CMP_GT_OQ);
+
+    acc[0] = _mm256_add_pd(acc[0], _mm256_and_pd(sel, one));
+    acc[1] = _mm256_add_pd(acc[1], _mm256_and_pd(sel, x));
+    acc[2] = _mm256_add_pd(acc[2], _mm256_andnot_pd(sel, x));
+    acc[3] = _mm256_add_pd(acc[3], _mm256_and_pd(sel, xx));
+    acc[4] = _mm256_add_pd(acc[4], _mm256_andnot_pd(sel, xx));
+    acc[5] = _mm256_add_pd(acc[5], _mm256_blendv_pd(l2, l1, sel));
+  }
+
+#define BIGAUSS_STORE(q, f)			\
+  _mm256_storeu_pd(r, acc[q]);			\
+  s[0].f += r[0]; s[1].f += r[1]; s[2].f += r[2]; s[3].f += r[3];
+  BIGAUSS_STORE(0, n1);
+  BIGAUSS_STORE(1, m1);
+  BIGAUSS_STORE(2, m2);
+  BIGAUSS_STORE(3, v1);
+  BIGAUSS_STORE(4, v2);
+  BIGAUSS_STORE(5, llk);
+#undef BIGAUSS_STORE
+
+  block_c(e + i, n - i, k, s);
+}
+#endif /* BIGAUSS_X86 */
+
+/* ------------------------------------------------------------------------- */
+/* ----- static void block_sum(const spf_t *, unsigned long,           ----- */
+/* -----                      const bigauss_coef_t *, int,             ----- */
+/* -----                      bigauss_sum_t *)                         ----- */
+/* ------------------------------------------------------------------------- */
+/*
+ * Compute the partial sums of a block with the given kernel, reducing
+ * the lanes in a fixed order.
+ */
+static void block_sum(const spf_t *e, unsigned long n, const bigauss_coef_t *k, int kernel, bigauss_sum_t *sum)
+{
+  bigauss_sum_t s[BIGAUSS_LANES];
+  int j;
+
+  for (j = 0; j < BIGAUSS_LANES; j++)
+    s[j].n1 = s[j].m1 = s[j].m2 = s[j].v1 = s[j].v2 = s[j].llk = 0.0;
+
+  switch (kernel) {
+#ifdef BIGAUSS_X86
+  case SPRO_KERNEL_AVX2:
+    block_avx2(e, n, k, s);
+    break;
+  case SPRO_KERNEL_SSE2:
+    block_sse2(e, n, k, s);
+    break;
+#endif
+  default:
+    block_c(e, n, k, s);
+  }
+
+#define BIGAUSS_REDUCE(f) sum->f = (s[0].f + s[1].f) + (s[2].f + s[3].f)
+  BIGAUSS_REDUCE(n1);
+  BIGAUSS_REDUCE(m1);
+  BIGAUSS_REDUCE(m2);
+  BIGAUSS_REDUCE(v1);
+  BIGAUSS_REDUCE(v2);
+  BIGAUSS_REDUCE(llk);
+#undef BIGAUSS_REDUCE
+}
+
+/* ---------------------------------------------- */
+/* ----- static void bigauss_worker(void *) ----- */
+/* ---------------------------------------------- */
+static void bigauss_worker(void *arg)
+{
+  bigauss_job_t *job = (bigauss_job_t *)arg;
+  unsigned long b, n;
+
+  for (b = job->b0; b < job->b1; b++) {
+    n = job->n - b * BIGAUSS_BLOCK;
+    if (n > BIGAUSS_BLOCK)
+      n = BIGAUSS_BLOCK;
+    block_sum(job->e + b * BIGAUSS_BLOCK, n, job->k, job->kernel, job->sum + b);
+  }
+}
+
+/* ----------------------------------------------------------------------------- */
+/* ----- int bigauss_stats(bigauss_t *, spfbuf_t *, int, bigauss_stat_t *) ----- */
+/* ----------------------------------------------------------------------------- */
+/*
+ * Assign each feature of e to the most likely gaussian of bg and
+ * return the per gaussian statistics in st, using at most nthreads
+ * threads (one per processor if nthreads <= 0). Return 0 if ok.
+ */
+int bigauss_stats(bigauss_t *bg, spfbuf_t *e, int nthreads, bigauss_stat_t *st)
+{
+  bigauss_coef_t k;
+  bigauss_sum_t sum0, *sum = &sum0;
+  bigauss_job_t job0, *job = &job0;
+  mthread_t *tid = NULL;
+  unsigned long nb, b;
+  int i, nt, nstarted, kernel = sig_pcm16_kernel(SPRO_KERNEL_QUERY);
+
+  /* same operations as the former per frame expression */
+  for (i = 0; i < 2; i++) {
+    k.a[i] = bg->v[i] * bg->m[i];
+    k.b[i] = 0.5 * bg->v[i];
+    k.c[i] = bg->c[i];
+  }
+
+  nb = (e->n + BIGAUSS_BLOCK - 1) / BIGAUSS_BLOCK;
+  if (nb == 0)
+    nb = 1;
+
+  if (nthreads <= 0)
+    nthreads = mthread_ncpu();
+  nt = (int)(nb / BIGAUSS_MT_MIN);
+  if (nt > nthreads)
+    nt = nthreads;
+  if (nt < 1)
+    nt = 1;
+
+  if (nb > 1) {
+    sum = (bigauss_sum_t *)malloc(nb * sizeof(bigauss_sum_t));
+    job = (bigauss_job_t *)malloc(nt * sizeof(bigauss_job_t));
+    tid = (mthread_t *)malloc(nt * sizeof(mthread_t));
+    if (sum == NULL || job == NULL || tid == NULL) {
+      fprintf(stderr, "bigauss_stats(): cannot allocate memory\n");
+      free(sum); free(job); free(tid);
+      return(SPRO_ALLOC_ERR);
+    }
+  }
+
+  for (i = 0; i < nt; i++) {
+    job[i].e = e->s;
+    job[i].n = e->n;
+    job[i].k = &k;
+    job[i].sum = sum;
+    job[i].b0 = nb * i / nt;
+    job[i].b1 = nb * (i + 1) / nt;
+    job[i].kernel = kernel;
+  }
+
+  /* the first job is ours, as are those for which no thread starts */
+  for (i = 1; i < nt; i++)
+    if (mthread_create(tid + i, bigauss_worker, job + i))
+      break;
+  nstarted = i;
+  bigauss_worker(job);
+  for (; i < nt; i++)
+    bigauss_worker(job + i);
+  for (i = 1; i < nstarted; i++)
+    mthread_join(tid[i]);
+
+  /* ----- reduce blocks in order ----- */
+  st->n[0] = st->n[1] = 0;
+  st->m[0] = st->m[1] = st->v[0] = st->v[1] = st->llk = 0.0;
+  for (b = 0; b < nb; b++) {
+    st->n[0] += (unsigned long)sum[b].n1;
+    st->m[0] += sum[b].m1;
+    st->m[1] += sum[b].m2;
+    st->v[0] += sum[b].v1;
+    st->v[1] += sum[b].v2;
+    st->llk += sum[b].llk;
+  }
+  st->n[1] = e->n - st->n[0];
+
+  if (sum != &sum0) {
+    free(sum);
+    free(job);
+    free(tid);
+  }
+
+  return(0);
+}
+
+/* ----------------------------------------------------------------------------------- */
+/* ----- bigauss_hist_t *bigauss_hist(spfbuf_t *, double, double, unsigned long) ----- */
+/* ----------------------------------------------------------------------------------- */
+/*
+ * Build a histogram of nbins bins of the features in [emin,emax],
+ * keeping for each bin the exact count, sum and sum of squares of its
+ * features. Return the histogram or NULL in case of error.
+ */
+bigauss_hist_t *bigauss_hist(spfbuf_t *e, double emin, double emax, unsigned long nbins)
+{
+  bigauss_hist_t *h;
+  unsigned long i, b;
+  double v;
+
+  if ((h = (bigauss_hist_t *)malloc(sizeof(bigauss_hist_t))) == NULL) {
+    fprintf(stderr, "bigauss_hist(): cannot allocate memory\n");
+    return(NULL);
+  }
+
+  h->nbins = (nbins) ? (nbins) : (1);
+  h->lo = emin;
+  h->width = (emax > emin) ? ((emax - emin) / h->nbins) : (1.0);
+  h->n = (unsigned long *)calloc(h->nbins, sizeof(unsigned long));
+  h->s1 = (double *)calloc(h->nbins, sizeof(double));
+  h->s2 = (double *)calloc(h->nbins, sizeof(double));
+  if (h->n == NULL || h->s1 == NULL || h->s2 == NULL) {
+    fprintf(stderr, "bigauss_hist(): cannot allocate memory\n");
+    bigauss_hist_free(h);
+    return(NULL);
+  }
+
+  for (i = 0; i < e->n; i++) {
+    v = *(e->s+i);
+    b = (v > h->lo) ? ((unsigned long)((v - h->lo) / h->width)) : (0);
+    if (b >= h->nbins)
+      b = h->nbins - 1;
+    h->n[b]++;
+    h->s1[b] += v;
+    h->s2[b] += v * v;
+  }
+
+  return(h);
+}
+
+/* ---------------------------------------------------- */
+/* ----- void bigauss_hist_free(bigauss_hist_t *) ----- */
+/* ---------------------------------------------------- */
+void bigauss_hist_free(bigauss_hist_t *h)
+{
+  if (h) {
+    free(h->n);
+    free(h->s1);
+    free(h->s2);
+    free(h);
+  }
+}
+
+/* ------------------------------------------------------------------------------------ */
+/* ----- void bigauss_hist_stats(bigauss_t *, bigauss_hist_t *, bigauss_stat_t *) ----- */
+/* ------------------------------------------------------------------------------------ */
+/*
+ * Same as bigauss_stats() on a histogram: each bin goes as a whole to
+ * the gaussian most likely for its mean. The statistics of a bin being
+ * exact, they differ from those of bigauss_stats() only by the frames
+ * of the bins straddling the decision boundary. The log-likelihood of
+ * a bin is exact as it is linear in the bin statistics.
+ */
+void bigauss_hist_stats(bigauss_t *bg, bigauss_hist_t *h, bigauss_stat_t *st)
+{
+  bigauss_coef_t k;
+  unsigned long b;
+  double v, llk1, llk2;
+  int i, j;
+
+  for (i = 0; i < 2; i++) {
+    k.a[i] = bg->v[i] * bg->m[i];
+    k.b[i] = 0.5 * bg->v[i];
+    k.c[i] = bg->c[i];
+  }
+
+  st->n[0] = st->n[1] = 0;
+  st->m[0] = st->m[1] = st->v[0] = st->v[1] = st->llk = 0.0;
+
+  for (b = 0; b < h->nbins; b++) {
+    if (h->n[b] == 0)
+      continue;
+
+    v = h->s1[b] / (double)h->n[b];
+    llk1 = k.a[0] * v - k.b[0] * v * v + k.c[0];
+    llk2 = k.a[1] * v - k.b[1] * v * v + k.c[1];
+    j = (llk1 > llk2) ? (0) : (1);
+
+    st->n[j] += h->n[b];
+    st->m[j] += h->s1[b];
+    st->v[j] += h->s2[b];
+    st->llk += k.a[j] * h->s1[b] - k.b[j] * h->s2[b] + k.c[j] * (double)h->n[b];
+  }
+}
+
+#undef _bigauss_c_
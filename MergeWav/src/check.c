@@ -0,0 +1,529 @@
+/******************************************************************************/
+/*                                                                            */
+/*                                  check.c                                   */
+/*                                                                            */
+/*****************************************************************************
+ * Self checks of the sample kernels and file formats.
+ *
+ * Each check builds its own input, runs it through the code under
+ * test and compares the result with a plain implementation or with
+ * the known answer. Checks on files write their fixtures into the
+ * current directory and remove them afterwards. One line per check is
+ * printed out, and MergeWavCheck() returns the number of failed ones.
+ */
+
+#define _check_c_
+
+#include "MergeWav.h"
+
+#define CHECK_NSAMPLES 4096     /* samples of the kernel checks               */
+#define CHECK_WAV "mwcheck.wav" /* wave fixtures                              */
+
+/* ------------------------------------------------------------ */
+/* ----- static unsigned long check_rand(unsigned long *) ----- */
+/* ------------------------------------------------------------ */
+/*
+ * Next value of a fixed linear congruential generator, in [0,2^31).
+ */
+static unsigned long check_rand(unsigned long *seed)
+{
+  *seed = (*seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+  return(*seed);
+}
+
+/* ------------------------------------------------------ */
+/* ----- static int check_report(const char *, int) ----- */
+/* ------------------------------------------------------ */
+static int check_report(const char *name, int nbad)
+{
+  printf("%-24s %s", name, (nbad) ? "FAILED" : "ok");
+  if (nbad)
+    printf(" (%d mismatches)", nbad);
+  printf("\n");
+
+  return(nbad != 0);
+}
+
+/* ---------------------------------------- */
+/* ----- static int check_sumsq(void) ----- */
+/* ---------------------------------------- */
+/*
+ * Sums of squares and frame energies of each kernel level against a
+ * plain 64 bits sum, on every length up to a few vector widths, with
+ * strides 1 to 3, unaligned starts and full scale samples.
+ */
+static int check_sumsq(void)
+{
+  short *p;
+  spf_t *e;
+  unsigned long seed = 1, i, n, nf, ref;
+  unsigned short stride;
+  int level, nbad, nfailed = 0, off;
+  char name[32];
+
+  if ((p = (short *)malloc(CHECK_NSAMPLES * sizeof(short))) == NULL || (e = (spf_t *)malloc(CHECK_NSAMPLES * sizeof(spf_t))) == NULL) {
+    fprintf(stderr, "MergeWavCheck: cannot allocate memory\n");
+    free(p);
+    return(1);
+  }
+
+  for (i = 0; i < CHECK_NSAMPLES; i++)
+    p[i] = (short)((long)(check_rand(&seed) & 0xFFFF) - 32768L);
+  for (i = 0; i < 64; i += 3)
+    p[i] = (i & 1) ? (32767) : (-32768);
+
+  for (level = SPRO_KERNEL_C; level <= SPRO_KERNEL_AVX2; level++) {
+    sprintf(name, "pcm16 sumsq level %d", level);
+    if (sig_pcm16_kernel(level) != level) {
+      printf("%-24s not supported\n", name);
+      continue;
+    }
+    nbad = 0;
+
+    for (stride = 1; stride <= 3; stride++)
+      for (off = 0; off < 2; off++)
+	for (n = 0; n <= 100; n++) {
+	  for (ref = 0, i = 0; i < n; i++)
+	    ref += (unsigned long)((long)p[off + i * stride] * p[off + i * stride]);
+	  if (sig_pcm16_sumsq(p + off, n, stride) != ref)
+	    nbad++;
+	}
+
+    /* overlapping frames, summed by blocks */
+    nf = (CHECK_NSAMPLES / 2 - 256) / 64 + 1;
+    if (sig_pcm16_energies(p + 1, nf, 256, 64, 2, e))
+      nbad++;
+    else
+      for (i = 0; i < nf; i++)
+	if (e[i] != (spf_t)sig_pcm16_energy(p + 1 + i * 64 * 2, 256, 2))
+	  nbad++;
+
+    nfailed += check_report(name, nbad);
+  }
+
+  sig_pcm16_kernel(SPRO_KERNEL_AUTO);
+  free(p);
+  free(e);
+
+  return(nfailed);
+}
+
+/* ---------------------------------------------------------------------------- */
+/* ----- static int check_segtab_same(const segtab_t *, const segtab_t *) ----- */
+/* ---------------------------------------------------------------------------- */
+/*
+ * Number of segments of a differing from those of b, boundaries,
+ * label strings and scores compared.
+ */
+static int check_segtab_same(const segtab_t *a, const segtab_t *b)
+{
+  unsigned long i;
+  int nbad = (a->n != b->n);
+
+  for (i = 0; i < a->n && i < b->n; i++)
+    if (a->seg[i].st != b->seg[i].st || a->seg[i].et != b->seg[i].et || a->seg[i].score != b->seg[i].score ||
+	strcmp(a->label[a->seg[i].label], b->label[b->seg[i].label]))
+      nbad++;
+
+  return(nbad);
+}
+
+/* ----------------------------------------- */
+/* ----- static int check_segtab(void) ----- */
+/* ----------------------------------------- */
+/*
+ * Segment table round trip through a segment list, then sorting,
+ * merging of overlapping, adjacent and close segments, and binary
+ * search on the merged table.
+ */
+static int check_segtab(void)
+{
+  /* sorted segments: adjacent, overlapping, another label, 100 samples apart */
+  static const struct { aseg_pos_t st, et; const char *label; float score; } seg[] = {
+    {0, 1600, "speech", 0.5f}, {1600, 4000, "speech", 0.75f}, {3000, 5000, "speech", 0.25f},
+    {8000, 8800, "noise+music", 1.0f}, {9000, 9600, "speech", 0.125f}, {9700, 12000, "speech", 0.375f}
+  };
+  /* sample, index of the segment of the table merged without gap holding it */
+  static const struct { aseg_pos_t pos; long i; } find[] = {
+    {0, 0}, {4999, 0}, {5000, -1}, {7999, -1}, {8000, 1}, {8799, 1}, {8800, -1},
+    {9599, 2}, {9600, -1}, {9700, 3}, {11999, 3}, {12000, -1}
+  };
+  unsigned long nseg = sizeof(seg) / sizeof(seg[0]), i, j;
+  segtab_t *tab, *back = NULL, *rev = NULL, *mtab = NULL;
+  asseg_t *list = NULL, *p;
+  int nbad = 0, k;
+
+  if ((tab = seg_tab_alloc(16000.0)) == NULL || (rev = seg_tab_alloc(16000.0)) == NULL) {
+    seg_tab_free(tab); seg_tab_free(rev);
+    return(check_report("segment tables", 1));
+  }
+
+  for (i = 0; i < nseg; i++) {
+    if ((k = seg_tab_label(tab, seg[i].label)) < 0 || seg_tab_append(tab, seg[i].st, seg[i].et, (unsigned short)k, seg[i].score) == NULL)
+      nbad++;
+    j = nseg - 1 - i;
+    if ((k = seg_tab_label(rev, seg[j].label)) < 0 || seg_tab_append(rev, seg[j].st, seg[j].et, (unsigned short)k, seg[j].score) == NULL)
+      nbad++;
+  }
+
+  /* ----- table to list and back ----- */
+  if ((list = seg_tab_to_list(tab)) == NULL || (back = seg_list_to_tab(list, tab->Fs)) == NULL)
+    nbad++;
+  else
+    nbad += check_segtab_same(tab, back);
+  seg_tab_free(back);
+
+  for (i = 0, p = list; p; p = get_seg_next(p))
+    i++;
+  nbad += (i != nseg);
+
+  /* ----- sort a reversed copy ----- */
+  seg_tab_sort(rev);
+  nbad += check_segtab_same(tab, rev);
+
+  /* ----- merge: touching and overlapping segments first, then 100 samples apart ----- */
+  if ((mtab = seg_list_to_tab(list, tab->Fs)) == NULL)
+    nbad++;
+  else {
+    nbad += (seg_tab_merge(mtab, 0) != 4);
+    nbad += (mtab->seg[0].st != 0 || mtab->seg[0].et != 5000 || mtab->seg[0].score != 0.75f);
+    nbad += (mtab->seg[1].st != 8000 || mtab->seg[1].et != 8800);
+    nbad += (mtab->seg[3].st != 9700 || mtab->seg[3].et != 12000);
+
+    for (i = 0; i < sizeof(find) / sizeof(find[0]); i++)
+      nbad += (seg_tab_find(mtab, find[i].pos) != find[i].i);
+
+    nbad += (seg_tab_merge(mtab, 99) != 4);
+    nbad += (seg_tab_merge(mtab, 100) != 3);
+    nbad += (mtab->seg[2].st != 9000 || mtab->seg[2].et != 12000 || mtab->seg[2].score != 0.375f);
+    nbad += (seg_tab_find(mtab, 9650) != 2);
+  }
+
+  seg_list_free(list);
+  seg_tab_free(mtab);
+  seg_tab_free(rev);
+  seg_tab_free(tab);
+
+  return(check_report("segment tables", nbad));
+}
+
+/* ---------------------------------------------------------------------------------- */
+/* ----- static unsigned char *put_le(unsigned char *, unsigned long long, int) ----- */
+/* ---------------------------------------------------------------------------------- */
+/*
+ * Store v as n little endian bytes at p. Return the next byte.
+ */
+static unsigned char *put_le(unsigned char *p, unsigned long long v, int n)
+{
+  for (; n; n--, v >>= 8)
+    *p++ = (unsigned char)(v & 0xFF);
+
+  return(p);
+}
+
+/* -------------------------------------------------------------------------- */
+/* ----- static unsigned char *put_chunk(unsigned char *, const char *, ----- */
+/* -----                                unsigned long)                  ----- */
+/* -------------------------------------------------------------------------- */
+static unsigned char *put_chunk(unsigned char *p, const char *id, unsigned long size)
+{
+  memcpy(p, id, 4);
+
+  return(put_le(p + 4, size, 4));
+}
+
+/* -------------------------------------------------------------------------- */
+/* ----- static unsigned char *put_fmt(unsigned char *, unsigned short, ----- */
+/* -----                              unsigned long, unsigned short)    ----- */
+/* -------------------------------------------------------------------------- */
+/*
+ * Store a 16 bytes PCM fmt chunk, header included.
+ */
+static unsigned char *put_fmt(unsigned char *p, unsigned short nch, unsigned long Fs, unsigned short nbits)
+{
+  p = put_chunk(p, "fmt ", 16);
+  p = put_le(p, SPRO_WAVE_FORMAT_PCM, 2);
+  p = put_le(p, nch, 2);
+  p = put_le(p, Fs, 4);
+  p = put_le(p, Fs * nch * (nbits / 8), 4);
+  p = put_le(p, nch * (nbits / 8), 2);
+
+  return(put_le(p, nbits, 2));
+}
+
+/* ------------------------------------------------------------------- */
+/* ----- static int check_fixture(const unsigned char *, size_t) ----- */
+/* ------------------------------------------------------------------- */
+/*
+ * Write n bytes to the fixture file. Return 0 if ok.
+ */
+static int check_fixture(const unsigned char *b, size_t n)
+{
+  FILE *f;
+  int status;
+
+  if ((f = fopen(CHECK_WAV, "wb")) == NULL) {
+    fprintf(stderr, "MergeWavCheck: cannot open %s\n", CHECK_WAV);
+    return(1);
+  }
+  status = (fwrite(b, 1, n, f) != n);
+
+  return((fclose(f) != 0) || status);
+}
+
+/* --------------------------------------------------- */
+/* ----- static int check_header(sigwavehdr_t *) ----- */
+/* --------------------------------------------------- */
+/*
+ * Read the header of the fixture with sig_wave_header(). Return its
+ * status.
+ */
+static int check_header(sigwavehdr_t *h)
+{
+  FILE *f;
+  int status;
+
+  if ((f = fopen(CHECK_WAV, "rb")) == NULL)
+    return(SPRO_SIG_READ_ERR);
+  status = sig_wave_header(f, h);
+  fclose(f);
+
+  return(status);
+}
+
+/* ----------------------------------------------------------------------- */
+/* ----- static int check_samples(int, const short *, unsigned long) ----- */
+/* ----------------------------------------------------------------------- */
+/*
+ * Number of the n 16 bits samples of the fixture read back through a
+ * stream of the given format differing from the expected ones s.
+ */
+static int check_samples(int format, const short *s, unsigned long n)
+{
+  sigstream_t *f;
+  const short *p;
+  unsigned long i;
+  int nbad = 0;
+
+  if ((f = sig_stream_open(CHECK_WAV, format, 0.0, 1024, 0)) == NULL)
+    return(1);
+
+  if (format == SPRO_SIG_MMAP_FORMAT)
+    p = (const short *)sig_stream_map_data(f);
+  else
+    p = (sig_stream_read(f) * f->nchannels == n) ? (f->buf->s) : (NULL);
+
+  if (p == NULL || f->nsamples * f->nchannels != n)
+    nbad++;
+  else
+    for (i = 0; i < n; i++)
+      nbad += (p[i] != s[i]);
+
+  sig_stream_close(f);
+
+  return(nbad);
+}
+
+/* ---------------------------------------------- */
+/* ----- static int check_wave_chunks(void) ----- */
+/* ---------------------------------------------- */
+/*
+ * Chunk walking of the WAVE parsers: LIST (odd sized, hence padded)
+ * and fact chunks between fmt and data, an extensible fmt chunk, and
+ * the rejection of a data chunk before the fmt one.
+ */
+static int check_wave_chunks(void)
+{
+  static const short s[8] = {1000, -1000, 32767, -32768, 7, -7, 256, -256};
+  unsigned char b[256], *p;
+  sigwavehdr_t h;
+  head_pama pt;
+  int nbad = 0, i;
+
+  /* ----- fmt, LIST of 5 bytes + pad, fact, data ----- */
+  p = put_fmt(b + 12, 1, 8000, 16);
+  p = put_chunk(p, "LIST", 5);
+  memcpy(p, "INFOx", 5);
+  p += 5;
+  *p++ = 0x00;
+  p = put_chunk(p, "fact", 4);
+  p = put_le(p, 8, 4);
+  p = put_chunk(p, "data", sizeof(s));
+  for (i = 0; i < 8; i++)
+    p = put_le(p, (unsigned short)s[i], 2);
+  put_chunk(b, "RIFF", (unsigned long)(p - b - 8));
+  memcpy(b + 8, "WAVE", 4);
+
+  if (check_fixture(b, p - b) || check_header(&h))
+    nbad++;
+  else
+    nbad += (h.format != SPRO_WAVE_FORMAT_PCM || h.nchannels != 1 || h.Fs != 8000 || h.blockalign != 2 ||
+	     h.dataoff != 70 || h.datasize != sizeof(s));
+  pt = wav_header_read(CHECK_WAV);
+  nbad += (pt.bits != 16 || pt.channels != 1 || pt.rate != 8000 || pt.datasize != 8 || pt.dataoff != 70);
+  nbad += check_samples(SPRO_SIG_WAVE_FORMAT, s, 8);
+  nbad += check_samples(SPRO_SIG_MMAP_FORMAT, s, 8);
+
+  /* ----- extensible fmt chunk, stereo ----- */
+  p = put_chunk(b + 12, "fmt ", 40);
+  p = put_le(p, SPRO_WAVE_FORMAT_EXTENSIBLE, 2);
+  p = put_le(p, 2, 2);
+  p = put_le(p, 16000, 4);
+  p = put_le(p, 64000, 4);
+  p = put_le(p, 4, 2);
+  p = put_le(p, 16, 2);
+  p = put_le(p, 22, 2);                     /* extension size */
+  p = put_le(p, 16, 2);                     /* valid bits */
+  p = put_le(p, 3, 4);                      /* channel mask */
+  p = put_le(p, SPRO_WAVE_FORMAT_PCM, 2);   /* sub format GUID */
+  memcpy(p, "\x00\x00\x00\x00\x10\x00\x80\x00\x00\xAA\x00\x38\x9B\x71", 14);
+  p += 14;
+  p = put_chunk(p, "data", sizeof(s));
+  for (i = 0; i < 8; i++)
+    p = put_le(p, (unsigned short)s[i], 2);
+  put_chunk(b, "RIFF", (unsigned long)(p - b - 8));
+
+  if (check_fixture(b, p - b) || check_header(&h))
+    nbad++;
+  else
+    nbad += (h.format != SPRO_WAVE_FORMAT_PCM || h.nchannels != 2 || h.dataoff != 68 || h.datasize != sizeof(s));
+  nbad += check_samples(SPRO_SIG_WAVE_FORMAT, s, 8);
+
+  /* ----- data before fmt ----- */
+  p = put_chunk(b + 12, "data", 4);
+  p = put_le(p, 0, 4);
+  p = put_fmt(p, 1, 8000, 16);
+  put_chunk(b, "RIFF", (unsigned long)(p - b - 8));
+
+  if (check_fixture(b, p - b) || check_header(&h) == 0)
+    nbad++;
+  pt = wav_header_read(CHECK_WAV);
+  nbad += (pt.channels != 0);
+
+  remove(CHECK_WAV);
+
+  return(check_report("wave chunks", nbad));
+}
+
+/* -------------------------------------------------------------------------- */
+/* ----- static int check_write(head_pama, const unsigned char *, size_t) ----- */
+/* -------------------------------------------------------------------------- */
+/*
+ * Write the fixture with wav_write_header() followed by n bytes of
+ * samples. Return the header length, or 0 on error.
+ */
+static int check_write(head_pama pt, const unsigned char *b, size_t n)
+{
+  FILE *f;
+  int len;
+
+  if ((f = fopen(CHECK_WAV, "wb")) == NULL) {
+    fprintf(stderr, "MergeWavCheck: cannot open %s\n", CHECK_WAV);
+    return(0);
+  }
+  len = wav_write_header(f, pt);
+  if (fwrite(b, 1, n, f) != n)
+    len = 0;
+
+  return((fclose(f) == 0) ? (len) : (0));
+}
+
+/* -------------------------------------------- */
+/* ----- static int check_wave_rf64(void) ----- */
+/* -------------------------------------------- */
+/*
+ * RF64 headers: the layout picked by wav_write_header() on each side
+ * of the RIFF limit, the JUNK chunk reserving the room of the ds64
+ * one, its rewrite in place once the data grows over 4 GB, and the
+ * ds64 sizes read back. The last fixture is a small RF64 file whose
+ * samples are read through the streams.
+ */
+static int check_wave_rf64(void)
+{
+  static const short s[8] = {1000, -1000, 32767, -32768, 7, -7, 256, -256};
+  unsigned char b[16], d[24], *p;
+  sigwavehdr_t h;
+  head_pama pt = {2, 16, 16000, 4, 0, WAV_LAYOUT_AUTO}, rd;
+  long long big = 0x40000000LL;             /* frames of 4 GB of stereo data */
+  FILE *f;
+  int nbad = 0, i;
+
+  for (p = b, i = 0; i < 8; i++)
+    p = put_le(p, (unsigned short)s[i], 2);
+
+  /* ----- small data, RIFF header unless room is reserved ----- */
+  nbad += (check_write(pt, b, sizeof(b)) != 44);
+  pt.layout = WAV_LAYOUT_RESERVE;
+  nbad += (check_write(pt, b, sizeof(b)) != 80);
+
+  if (check_header(&h))
+    nbad++;
+  else
+    nbad += (h.nchannels != 2 || h.dataoff != 80 || h.datasize != sizeof(b));
+  nbad += check_samples(SPRO_SIG_WAVE_FORMAT, s, 8);
+
+  /* ----- rewrite of the reserved header with over 4 GB of data ----- */
+  pt.datasize = big;
+  if ((f = fopen(CHECK_WAV, "r+b")) == NULL)
+    nbad++;
+  else {
+    nbad += (wav_write_header(f, pt) != 80);
+    nbad += (fseek(f, 0, SEEK_END) != 0 || ftell(f) != 80 + (long)sizeof(b));
+    nbad += (fclose(f) != 0);
+  }
+
+  if (check_header(&h))
+    nbad++;
+  else
+    nbad += (h.nchannels != 2 || h.dataoff != 80 || h.datasize != (unsigned long long)big * 4);
+  rd = wav_header_read(CHECK_WAV);
+  nbad += (rd.channels != 2 || rd.datasize != big || rd.dataoff != 80);
+
+  /* ----- ds64 round trip, with the ds64 sizes then set to the actual ones ----- */
+  pt.layout = WAV_LAYOUT_AUTO;
+  nbad += (check_write(pt, b, sizeof(b)) != 80);
+
+  if ((f = fopen(CHECK_WAV, "r+b")) == NULL)
+    nbad++;
+  else {
+    nbad += (fread(d, 1, 4, f) != 4 || memcmp(d, "RF64", 4) != 0);
+    p = put_le(d, 72 + sizeof(b), 8);
+    p = put_le(p, sizeof(b), 8);
+    put_le(p, 4, 8);
+    nbad += (fseek(f, 20, SEEK_SET) != 0 || fwrite(d, 1, sizeof(d), f) != sizeof(d));
+    nbad += (fclose(f) != 0);
+  }
+
+  if (check_header(&h))
+    nbad++;
+  else
+    nbad += (h.dataoff != 80 || h.datasize != 16);
+  nbad += check_samples(SPRO_SIG_WAVE_FORMAT, s, 8);
+  nbad += check_samples(SPRO_SIG_MMAP_FORMAT, s, 8);
+
+  remove(CHECK_WAV);
+
+  return(check_report("wave rf64", nbad));
+}
+
+/* ----------------------------------- */
+/* ----- int MergeWavCheck(void) ----- */
+/* ----------------------------------- */
+/*
+ * Run all the checks. Return the number of failed ones.
+ */
+int MergeWavCheck(void)
+{
+  int nfailed = 0;
+
+  nfailed += check_sumsq();
+  nfailed += check_segtab();
+  nfailed += check_wave_chunks();
+  nfailed += check_wave_rf64();
+
+  printf("# checks failed=%d\n", nfailed);
+
+  return(nfailed);
+}
+
+#undef _check_c_
@@ -0,0 +1,353 @@
+/******************************************************************************/
+/*                                                                            */
+/*                                 energy.c                                   */
+/*                                                                            */
+/*****************************************************************************
+ * Frame energy kernels for 16 bits PCM samples.
+ *
+ * sig_normalize() computes the energy of a frame of sample_t, each
+ * sample being converted to double before being squared and summed.
+ * For 16 bits input, the squares are integers below 2^30 and are
+ * summed here exactly as 64 bits integers, straight from the PCM
+ * samples. The SIMD kernels square and add pairs of samples with
+ * pmaddwd, whose 32 bits results lie in [0,2^31] and are therefore
+ * taken as unsigned and widened to 64 bits before accumulation (two
+ * -32768 samples would overflow a signed accumulator).
+ *
+ * Tolerance: the sum of squares is exact whatever the kernel. As long
+ * as it is below 2^53, which holds for any frame shorter than 2^23
+ * samples, the double accumulation of sig_normalize() is exact as well
+ * and both energies are bit identical. For longer frames, the energy
+ * returned here is the correctly rounded one, sig_normalize() being
+ * off by at most n * 2^-53 relative.
+ *
+ * The kernel is the best one for the processor (AVX2, then SSE2, then
+ * plain C) unless forced with sig_pcm16_kernel(), e.g. for
+ * benchmarking, before any thread is started. The processor is probed
+ * once, by the first selection, and the kernels then only read the
+ * selection, once per call, so that concurrent calls never write it
+ * and never run cpuid.
+ *
+ * sig_pcm16_energies() computes a whole profile of overlapping frames
+ * squaring each sample once: a frame is the sum of l/g consecutive
+ * blocks of g = gcd(l,d) samples and the frame sum slides by d/g
+ * blocks at each step. Since the sums are integers, the sliding sum
+ * never drifts and needs no periodic resynchronization: every frame
+ * energy is the one sig_pcm16_energy() would return.
+ *
+ * sig_energies() is the entry point for any PCM format: 16 bits
+ * channels go to the kernels above, whereas 8, 24 and 32 bits samples
+ * and the mean of several channels are converted by the sig_converter()
+ * kernels and go through sig_normalize(), as get_next_sig_frame()
+ * frames do.
+ */
+
+#define _energy_c_
+
+#define SPRO_MIN_BLOCK 32         /* smaller blocks: compute frames directly  */
+#define SPRO_MAX_BLOCKS 64        /* max. blocks per frame without malloc()   */
+
+#include "spro.h"
+#include <math.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+# define SPRO_X86 1
+# define SPRO_TARGET(isa)
+# include <intrin.h>
+# include <immintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+# define SPRO_X86 1
+# define SPRO_TARGET(isa) __attribute__((target(isa)))
+# include <immintrin.h>
+#endif
+
+static int kernel = -1;           /* forced kernel, -1 for the best one       */
+static int best = -1;             /* processor best kernel, -1 until probed   */
+
+/* --------------------------------------------------------------------------- */
+/* ----- static unsigned long long sumsq_c(const short *, unsigned long, ----- */
+/* -----                                  unsigned short)                ----- */
+/* --------------------------------------------------------------------------- */
+static unsigned long long sumsq_c(const short *p, unsigned long n, unsigned short stride)
+{
+  unsigned long long s = 0;
+  long v;
+
+  for (; n; n--, p += stride) {
+    v = *p;
+    s += (unsigned long)(v * v);
+  }
+
+  return(s);
+}
+
+#ifdef SPRO_X86
+/* ------------------------------------------------------------------------------ */
+/* ----- static unsigned long long sumsq_sse2(const short *, unsigned long) ----- */
+/* ------------------------------------------------------------------------------ */
+SPRO_TARGET("sse2")
+static unsigned long long sumsq_sse2(const short *p, unsigned long n)
+{
+  __m128i acc = _mm_setzero_si128(), zero = _mm_setzero_si128(), x;
+  unsigned long long r[2];
+  unsigned long i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    x = _mm_loadu_si128((const __m128i *)(p + i));
+    x = _mm_madd_epi16(x, x);
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(x, zero));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(x, zero));
+  }
+
+  _mm_storeu_si128((__m128i *)r, acc);
+
+  return(r[0] + r[1] + sumsq_c(p + i, n - i, 1));
+}
+
+/* ------------------------------------------------------------------------------ */
+/* ----- static unsigned long long sumsq_avx2(const short *, unsigned long) ----- */
+/* ------------------------------------------------------------------------------ */
+SPRO_TARGET("avx2")
+static unsigned long long sumsq_avx2(const short *p, unsigned long n)
+{
+  __m256i acc = _mm256_setzero_si256(), zero = _mm256_setzero_si256(), x;
+  unsigned long long r[4];
+  unsigned long i;
+
+  for (i = 0; i + 16 <= n; i += 16) {
+    x = _mm256_loadu_si256((const __m256i *)(p + i));
+    x = _mm256_madd_epi16(x, x);
+    acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(x, zero));
+    acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(x, zero));
+  }
+
+  _mm256_storeu_si256((__m256i *)r, acc);
+
+  return(r[0] + r[1] + r[2] + r[3] + sumsq_sse2(p + i, n - i));
+}
+
+/* --------------------------------------- */
+/* ----- static int cpu_kernel(void) ----- */
+/* --------------------------------------- */
+/*
+ * Return the best kernel supported by the processor and the system.
+ */
+static int cpu_kernel(void)
+{
+#ifdef _MSC_VER
+  int r[4];
+
+  __cpuid(r, 0);
+  if (r[0] >= 7) {
+    __cpuid(r, 1);
+    if ((r[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6) { /* OS saves the YMM registers */
+      __cpuidex(r, 7, 0);
+      if (r[1] & (1 << 5))
+	return(SPRO_KERNEL_AVX2);
+    }
+  }
+  __cpuid(r, 1);
+  return((r[3] & (1 << 26)) ? (SPRO_KERNEL_SSE2) : (SPRO_KERNEL_C));
+#else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return(SPRO_KERNEL_AVX2);
+  return((__builtin_cpu_supports("sse2")) ? (SPRO_KERNEL_SSE2) : (SPRO_KERNEL_C));
+#endif
+}
+#else
+static int cpu_kernel(void)
+{
+  return(SPRO_KERNEL_C);
+}
+#endif /* SPRO_X86 */
+
+/* ------------------------------------- */
+/* ----- int sig_pcm16_kernel(int) ----- */
+/* ------------------------------------- */
+/*
+ * Select the energy kernel: SPRO_KERNEL_AUTO for the best one, or any
+ * lower level. Return the kernel in use, which may be lower than the
+ * one requested if the processor lacks support. Called with
+ * SPRO_KERNEL_QUERY, simply return the kernel in use without changing
+ * the selection, which makes it the only call safe from concurrent
+ * threads. The first selection probes the processor once for all, after
+ * which queries only read the selection.
+ */
+int sig_pcm16_kernel(int level)
+{
+  /* a forced kernel is already capped, and the processor only probed
+     here, without keeping the result, before any selection */
+  if (level == SPRO_KERNEL_QUERY)
+    return((kernel >= 0) ? (kernel) : (best >= 0) ? (best) : (cpu_kernel()));
+
+  if (best < 0)
+    best = cpu_kernel();
+
+  if (level == SPRO_KERNEL_AUTO) {
+    kernel = -1;
+    return(best);
+  }
+
+  if (level > best)
+    level = best;
+
+  kernel = (level < SPRO_KERNEL_C) ? (SPRO_KERNEL_C) : (level);
+
+  return(kernel);
+}
+
+/* ------------------------------------------------------------------------------ */
+/* ----- static unsigned long long sumsq(int, const short *, unsigned long, ----- */
+/* -----                                unsigned short)                     ----- */
+/* ------------------------------------------------------------------------------ */
+static unsigned long long sumsq(int level, const short *p, unsigned long n, unsigned short stride)
+{
+#ifdef SPRO_X86
+  if (stride == 1) {
+    if (level == SPRO_KERNEL_AVX2)
+      return(sumsq_avx2(p, n));
+    if (level == SPRO_KERNEL_SSE2)
+      return(sumsq_sse2(p, n));
+  }
+#endif
+
+  return(sumsq_c(p, n, stride));
+}
+
+/* ---------------------------------------------------------------------------- */
+/* ----- unsigned long long sig_pcm16_sumsq(const short *, unsigned long, ----- */
+/* -----                                   unsigned short)                ----- */
+/* ---------------------------------------------------------------------------- */
+/*
+ * Return the exact sum of squares of n samples, stride shorts apart
+ * (i.e. the number of channels for interleaved samples).
+ */
+unsigned long long sig_pcm16_sumsq(const short *p, unsigned long n, unsigned short stride)
+{
+  return(sumsq(sig_pcm16_kernel(SPRO_KERNEL_QUERY), p, n, stride));
+}
+
+/* ----------------------------------------------------------------- */
+/* ----- double sig_pcm16_energy(const short *, unsigned long, ----- */
+/* -----                         unsigned short)               ----- */
+/* ----------------------------------------------------------------- */
+/*
+ * Return the frame energy, i.e. the square root of the sum of
+ * squares, as sig_normalize() does for the same samples.
+ */
+double sig_pcm16_energy(const short *p, unsigned long n, unsigned short stride)
+{
+  return(sqrt((double)sig_pcm16_sumsq(p, n, stride)));
+}
+
+/* -------------------------------------------------------------------------------- */
+/* ----- int sig_pcm16_energies(const short *, unsigned long, unsigned short, ----- */
+/* -----                       unsigned short, unsigned short, spf_t *)       ----- */
+/* -------------------------------------------------------------------------------- */
+/*
+ * Compute the energies of nf frames of l samples every d samples, the
+ * first frame starting at p, into e. Samples are stride shorts
+ * apart. Return 0 if ok.
+ */
+int sig_pcm16_energies(const short *p, unsigned long nf, unsigned short l, unsigned short d, unsigned short stride, spf_t *e)
+{
+  unsigned long long r0[SPRO_MAX_BLOCKS], *r = r0, sum = 0;
+  unsigned long i, k, nb, ns, pos, blk;
+  unsigned short g, a, b;
+  int level;
+
+  if (nf == 0)
+    return(0);
+
+  level = sig_pcm16_kernel(SPRO_KERNEL_QUERY);
+
+  /* block length */
+  for (a = l, b = d; b; ) {
+    g = a % b;
+    a = b;
+    b = g;
+  }
+  g = a;
+
+  /* no overlap or tiny blocks: frame by frame */
+  if (d >= l || g < SPRO_MIN_BLOCK) {
+    for (i = 0; i < nf; i++, p += (unsigned long)d * stride)
+      *(e+i) = (spf_t)sqrt((double)sumsq(level, p, l, stride));
+    return(0);
+  }
+
+  nb = l / g;
+  ns = d / g;
+
+  if (nb > SPRO_MAX_BLOCKS && (r = (unsigned long long *)malloc(nb * sizeof(unsigned long long))) == NULL) {
+    fprintf(stderr, "sig_pcm16_energies(): cannot allocate memory\n");
+    return(SPRO_ALLOC_ERR);
+  }
+
+  /* ----- first frame ----- */
+  for (blk = 0; blk < nb; blk++) {
+    *(r+blk) = sumsq(level, p + (size_t)blk * g * stride, g, stride);
+    sum += *(r+blk);
+  }
+  *e = (spf_t)sqrt((double)sum);
+
+  /* ----- slide by ns blocks, dropping the oldest ones ----- */
+  for (i = 1, pos = 0; i < nf; i++) {
+    for (k = 0; k < ns; k++, blk++) {
+      sum -= *(r+pos);
+      *(r+pos) = sumsq(level, p + (size_t)blk * g * stride, g, stride);
+      sum += *(r+pos);
+      if (++pos == nb)
+	pos = 0;
+    }
+    *(e+i) = (spf_t)sqrt((double)sum);
+  }
+
+  if (r != r0)
+    free(r);
+
+  return(0);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----- int sig_energies(const char *, unsigned long, unsigned short, ----- */
+/* -----                 unsigned short, int, unsigned short, int,     ----- */
+/* -----                 spf_t *)                                      ----- */
+/* ------------------------------------------------------------------------- */
+/*
+ * Compute the energies of nf frames of l samples every d samples into
+ * e, the first frame starting at p. Samples are nbps bytes long and
+ * interleaved over nch channels, of which ch (starting at 1) is
+ * analysed, or the mean of all of them if ch is 0. Return 0 if ok.
+ */
+int sig_energies(const char *p, unsigned long nf, unsigned short l, unsigned short d, int nbps, unsigned short nch, int ch, spf_t *e)
+{
+  spsig_t *frame;
+  sig_conv_t conv;
+  unsigned long i;
+
+  if (nbps == 2 && ch > 0)
+    return(sig_pcm16_energies((const short *)p + (ch - 1), nf, l, d, nch, e));
+
+  if ((conv = sig_converter(nbps, nch, ch)) == NULL) {
+    fprintf(stderr, "sig_energies(): unsupported sample format\n");
+    return(SPRO_BAD_PARAM_ERR);
+  }
+
+  if ((frame = sig_alloc(l)) == NULL) {
+    fprintf(stderr, "sig_energies(): cannot allocate memory\n");
+    return(SPRO_ALLOC_ERR);
+  }
+
+  for (i = 0; i < nf; i++, p += (size_t)d * nch * nbps) {
+    conv(p, l, nch, ch, frame->s);
+    *(e+i) = (spf_t)sig_normalize(frame, 0);
+  }
+
+  sig_free(frame);
+
+  return(0);
+}
+
+#undef _energy_c_
@@ -0,0 +1,127 @@
+/******************************************************************************/
+/*                                                                            */
+/*                                 fsplice.c                                  */
+/*                                                                            */
+/*****************************************************************************
+ * File to file copies for the segment writer.
+ *
+ * The speech segments of 16 bits PCM input are byte ranges of the
+ * input file, so on Linux they are copied kernel side with
+ * copy_file_range(), or sendfile() on older kernels and across file
+ * systems. Whatever could not be copied that way is left to the
+ * caller's buffered copy. Segment padding is not written at all when
+ * the output is at its end: the file is simply extended, leaving a
+ * hole which reads as zeros.
+ *
+ * Both functions work on stdio streams: the output stream is flushed
+ * before touching its descriptor and repositioned afterwards.
+ */
+
+#ifdef __linux__
+# define _GNU_SOURCE
+# define _FILE_OFFSET_BITS 64
+#endif
+
+#include "fsplice.h"
+
+#ifdef HAVE_FILE_SPLICE
+# include <errno.h>
+# include <unistd.h>
+# include <sys/types.h>
+# include <sys/sendfile.h>
+#endif
+
+#define FZERO_BLOCK 65536
+
+/* ------------------------------------------------------------------- */
+/* ----- long long fsplice(FILE *, long long, long long, FILE *) ----- */
+/* ------------------------------------------------------------------- */
+/*
+ * Copy len bytes from offset off of infp to outfp inside the
+ * kernel. Return the number of bytes copied.
+ */
+long long fsplice(FILE *infp, long long off, long long len, FILE *outfp)
+{
+#ifdef HAVE_FILE_SPLICE
+  int ifd = fileno(infp), ofd = fileno(outfp);
+  loff_t ioff = off;
+  off_t soff;
+  long long done = 0;
+  ssize_t n;
+
+  if (len <= 0 || fflush(outfp) != 0)
+    return(0);
+
+  while (done < len) {
+    n = copy_file_range(ifd, &ioff, ofd, NULL, (size_t)(len - done), 0);
+    if (n <= 0)
+      break;
+    done += n;
+  }
+
+  /* ENOSYS, EXDEV, EINVAL... try sendfile() from where we are */
+  soff = (off_t)(off + done);
+  while (done < len) {
+    n = sendfile(ofd, ifd, &soff, (size_t)(len - done));
+    if (n <= 0)
+      break;
+    done += n;
+  }
+
+  if (done)
+    fseeko(outfp, lseek(ofd, 0, SEEK_CUR), SEEK_SET);
+
+  return(done);
+#else
+  return(0);
+#endif
+}
+
+/* ----------------------------------------------- */
+/* ----- int fseek64(FILE *, long long, int) ----- */
+/* ----------------------------------------------- */
+/*
+ * fseek() beyond 2 GB, where long is 32 bits wide.
+ */
+int fseek64(FILE *f, long long off, int whence)
+{
+#if defined(_MSC_VER)
+  return(_fseeki64(f, off, whence));
+#elif defined(_WIN32)
+  return(fseeko64(f, off, whence));
+#else
+  return(fseeko(f, (off_t)off, whence));
+#endif
+}
+
+/* ---------------------------------------- */
+/* ----- int fzero(FILE *, long long) ----- */
+/* ---------------------------------------- */
+/*
+ * Write len null bytes to outfp. Return 0 if ok.
+ */
+int fzero(FILE *outfp, long long len)
+{
+  static const char zero[FZERO_BLOCK] = {0};
+  size_t n;
+#ifdef HAVE_FILE_SPLICE
+  int ofd = fileno(outfp);
+  off_t pos, end;
+
+  if (len > 0 && fflush(outfp) == 0) {
+    pos = lseek(ofd, 0, SEEK_CUR);
+    end = lseek(ofd, 0, SEEK_END);
+    if (pos >= 0 && pos >= end && ftruncate(ofd, pos + len) == 0)
+      return(fseeko(outfp, pos + len, SEEK_SET));
+    lseek(ofd, pos, SEEK_SET);
+  }
+#endif
+
+  for (; len > 0; len -= n) {
+    n = (len < FZERO_BLOCK) ? (size_t)len : FZERO_BLOCK;
+    if (fwrite(zero, 1, n, outfp) != n)
+      return(1);
+  }
+
+  return(0);
+}
@@ -0,0 +1,166 @@
+/******************************************************************************/
+/*                                                                            */
+/*                                 mthread.c                                  */
+/*                                                                            */
+/*****************************************************************************
+ * Minimal portable thread layer.
+ *
+ * Just what the batch driver needs: starting and joining threads,
+ * plain mutexes, the number of processors and a wall clock. Win32
+ * threads are used under Windows, POSIX threads everywhere else.
+ */
+
+#include <stdlib.h>
+#include "mthread.h"
+
+#ifdef _WIN32
+# include <process.h>
+#else
+# include <unistd.h>
+# include <sys/time.h>
+#endif
+
+typedef struct {
+  void (*fn)(void *);
+  void *arg;
+} mthread_start_t;
+
+/* ---------------------------------------- */
+/* ----- static mthread_start(void *) ----- */
+/* ---------------------------------------- */
+/*
+ * Thread entry point, calling the user function with its argument.
+ */
+#ifdef _WIN32
+static unsigned __stdcall mthread_start(void *p)
+#else
+static void *mthread_start(void *p)
+#endif
+{
+  mthread_start_t start = *(mthread_start_t *)p;
+
+  free(p);
+  start.fn(start.arg);
+
+  return(0);
+}
+
+/* --------------------------------------------------------------------- */
+/* ----- int mthread_create(mthread_t *, void (*)(void *), void *) ----- */
+/* --------------------------------------------------------------------- */
+/*
+ * Start a thread running fn(arg). Return 0 if ok.
+ */
+int mthread_create(mthread_t *t, void (*fn)(void *), void *arg)
+{
+  mthread_start_t *p;
+
+  if ((p = (mthread_start_t *)malloc(sizeof(mthread_start_t))) == NULL)
+    return(1);
+
+  p->fn = fn;
+  p->arg = arg;
+
+#ifdef _WIN32
+  if ((*t = (HANDLE)_beginthreadex(NULL, 0, mthread_start, p, 0, NULL)) == 0) {
+#else
+  if (pthread_create(t, NULL, mthread_start, p) != 0) {
+#endif
+    free(p);
+    return(1);
+  }
+
+  return(0);
+}
+
+/* ---------------------------------------- */
+/* ----- void mthread_join(mthread_t) ----- */
+/* ---------------------------------------- */
+void mthread_join(mthread_t t)
+{
+#ifdef _WIN32
+  WaitForSingleObject(t, INFINITE);
+  CloseHandle(t);
+#else
+  pthread_join(t, NULL);
+#endif
+}
+
+/* ---------------------------------- */
+/* ----- int mthread_ncpu(void) ----- */
+/* ---------------------------------- */
+int mthread_ncpu(void)
+{
+#ifdef _WIN32
+  SYSTEM_INFO si;
+
+  GetSystemInfo(&si);
+
+  return((int)si.dwNumberOfProcessors);
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return((n > 0) ? (int)n : 1);
+#endif
+}
+
+/* -------------------------------------- */
+/* ----- double mthread_clock(void) ----- */
+/* -------------------------------------- */
+double mthread_clock(void)
+{
+#ifdef _WIN32
+  LARGE_INTEGER f, c;
+
+  QueryPerformanceFrequency(&f);
+  QueryPerformanceCounter(&c);
+
+  return((double)c.QuadPart / (double)f.QuadPart);
+#else
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return((double)tv.tv_sec + 1e-6 * (double)tv.tv_usec);
+#endif
+}
+
+     /* ------------------- */
+     /* ----- mutexes ----- */ 
+     /* ------------------- */
+
+void mmutex_init(mmutex_t *m)
+{
+#ifdef _WIN32
+  InitializeSRWLock(m);
+#else
+  pthread_mutex_init(m, NULL);
+#endif
+}
+
+void mmutex_lock(mmutex_t *m)
+{
+#ifdef _WIN32
+  AcquireSRWLockExclusive(m);
+#else
+  pthread_mutex_lock(m);
+#endif
+}
+
+void mmutex_unlock(mmutex_t *m)
+{
+#ifdef _WIN32
+  ReleaseSRWLockExclusive(m);
+#else
+  pthread_mutex_unlock(m);
+#endif
+}
+
+void mmutex_destroy(mmutex_t *m)
+{
+#ifdef _WIN32
+  (void)m; /* nothing to release */
+#else
+  pthread_mutex_destroy(m);
+#endif
+}
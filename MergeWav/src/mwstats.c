@@ -0,0 +1,114 @@
+/******************************************************************************/
+/*                                                                            */
+/*                                 mwstats.c                                  */
+/*                                                                            */
+/*****************************************************************************
+ * Instrumentation counters.
+ *
+ * A mwstats_t is handed down with the processing options of a file
+ * (mergeopt_t) to the detector context, the output and the stream
+ * readers, which count their calls and bytes into it and time their
+ * stages. Counters are only requested per file, so that concurrent
+ * files of a batch never share any. When no counters are requested,
+ * the pointer is NULL and the cost is a test per buffer, not per
+ * sample: the clock is not even read.
+ *
+ * The counters are dumped as a JSON object, e.g.
+ *
+ *   {"input": "a.wav", "bytes_read": 3840000, ...,
+ *    "seconds": {"open": 0.000084, "profile": 0.005502, ...}}
+ */
+
+#define _mwstats_c_
+
+#include "mwstats.h"
+#include "mthread.h"
+#include <string.h>
+
+static const char *mwstats_stage_name[MWSTATS_NSTAGES] = {
+  "open", "profile", "em", "seg", "write", "stream", "header"
+};
+
+/* ------------------------------------------ */
+/* ----- void mwstats_init(mwstats_t *) ----- */
+/* ------------------------------------------ */
+void mwstats_init(mwstats_t *p)
+{
+  int i;
+
+  p->nbytes_read = p->nbytes_written = 0;
+  p->nfread = p->nfwrite = p->nfseek = 0;
+  p->nresize = p->niter = p->nseg = 0;
+
+  for (i = 0; i < MWSTATS_NSTAGES; i++)
+    p->t[i] = 0.0;
+}
+
+/* --------------------------------------------------- */
+/* ----- double mwstats_clock(const mwstats_t *) ----- */
+/* --------------------------------------------------- */
+double mwstats_clock(const mwstats_t *p)
+{
+  return((p) ? (mthread_clock()) : (0.0));
+}
+
+/* -------------------------------------------------------- */
+/* ----- void mwstats_stage(mwstats_t *, int, double) ----- */
+/* -------------------------------------------------------- */
+void mwstats_stage(mwstats_t *p, int stage, double t)
+{
+  if (p)
+    p->t[stage] += mthread_clock() - t;
+}
+
+/* ---------------------------------------------------------------------------- */
+/* ----- int mwstats_write(const mwstats_t *, const char *, const char *) ----- */
+/* ---------------------------------------------------------------------------- */
+/*
+ * Write the counters of input to fn, as a single line JSON object
+ * appended to the file (one object per line over a batch). Return 0
+ * if ok.
+ */
+int mwstats_write(const mwstats_t *p, const char *input, const char *fn)
+{
+  FILE *f;
+  const char *c;
+  int i, status = 0;
+
+  if (fn == NULL || strcmp(fn, "-") == 0)
+    f = stdout;
+  else if ((f = fopen(fn, "a")) == NULL) {
+    fprintf(stderr, "mwstats_write() -- cannot open %s\n", fn);
+    return(1);
+  }
+
+  /* file names may hold quotes and backslashes (Windows paths) */
+  fprintf(f, "{\"input\": \"");
+  for (c = (input) ? (input) : ("-"); *c; c++)
+    if (*c == '"' || *c == '\\')
+      fprintf(f, "\\%c", *c);
+    else if ((unsigned char)*c < 0x20)
+      fprintf(f, "\\u%04x", (unsigned char)*c);
+    else
+      fputc(*c, f);
+
+  fprintf(f, "\", \"bytes_read\": %llu, \"bytes_written\": %llu", p->nbytes_read, p->nbytes_written);
+  fprintf(f, ", \"freads\": %lu, \"fwrites\": %lu, \"fseeks\": %lu", p->nfread, p->nfwrite, p->nfseek);
+  fprintf(f, ", \"reallocs\": %lu, \"em_iterations\": %lu, \"segments\": %lu", p->nresize, p->niter, p->nseg);
+
+  fprintf(f, ", \"seconds\": {");
+  for (i = 0; i < MWSTATS_NSTAGES; i++)
+    fprintf(f, "%s\"%s\": %.6f", (i) ? (", ") : (""), mwstats_stage_name[i], p->t[i]);
+  fprintf(f, "}}\n");
+
+  if (ferror(f))
+    status = 1;
+  if (f != stdout && fclose(f) != 0)
+    status = 1;
+  else if (f == stdout)
+    fflush(f);
+
+  return(status);
+}
+
+#undef _mwstats_c_
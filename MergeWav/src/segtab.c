@@ -0,0 +1,365 @@
+/******************************************************************************/
+/*                                                                            */
+/*                                 segtab.c                                   */
+/*                                                                            */
+/*****************************************************************************
+ * Packed segment tables.
+ *
+ * A segment table (segtab_t) holds a segmentation as a single array
+ * of segment records, each made of its first and last+1 samples, the
+ * index of its label in the table label list and its score. Compared
+ * with the asseg_t d-list, appending costs no allocation beyond the
+ * geometric growth of the array, walking the segments is a linear
+ * scan of memory and the segments can be sorted, merged and looked up
+ * by binary search.
+ *
+ * Boundaries are 64 bits sample indices rather than times, so that no
+ * rounding happens between the frames of the detector and the samples
+ * copied out, however long the signal. Times are only computed, in
+ * double precision as sample / Fs, when writing the table out or
+ * converting it to a segment list.
+ *
+ * seg_tab_write() writes the same text format as seg_write().
+ */
+
+#define _segtab_c_
+
+#include "audioseg.h"
+#include <STDLIB.H>
+#include <STRING.H>
+
+#define SEG_TAB_BLOCK 256         /* initial number of segments in a table    */
+
+/* ------------------------------------------ */
+/* ----- segtab_t *seg_tab_alloc(float) ----- */
+/* ------------------------------------------ */
+/*
+ * Allocate an empty table for segments of a signal sampled at Fs.
+ */
+segtab_t *seg_tab_alloc(float Fs)
+{
+  segtab_t *p;
+
+  if ((p = (segtab_t *)malloc(sizeof(segtab_t))) == NULL) {
+    fprintf(stderr, "seg_tab_alloc() -- cannot allocate %lu bytes\n", (unsigned long)sizeof(segtab_t));
+    return(NULL);
+  }
+
+  p->Fs = Fs;
+  p->n = p->m = 0;
+  p->seg = NULL;
+  p->nlabels = 0;
+  p->label = NULL;
+
+  return(p);
+}
+
+/* ----------------------------------------- */
+/* ----- void seg_tab_free(segtab_t *) ----- */
+/* ----------------------------------------- */
+void seg_tab_free(segtab_t *p)
+{
+  unsigned short i;
+
+  if (p) {
+    for (i = 0; i < p->nlabels; i++)
+      free(p->label[i]);
+    free(p->label);
+    free(p->seg);
+    free(p);
+  }
+}
+
+/* ------------------------------------------------------- */
+/* ----- int seg_tab_label(segtab_t *, const char *) ----- */
+/* ------------------------------------------------------- */
+/*
+ * Return the index of the label string str in the table, adding it
+ * the first time it is seen, or -1 in case of error.
+ */
+int seg_tab_label(segtab_t *p, const char *str)
+{
+  unsigned short i;
+  char **label;
+
+  for (i = 0; i < p->nlabels; i++)
+    if (strcmp(p->label[i], str) == 0)
+      return(i);
+
+  if (p->nlabels == (unsigned short)-1) {
+    fprintf(stderr, "seg_tab_label() -- too many labels\n");
+    return(-1);
+  }
+
+  if ((label = (char **)realloc(p->label, (p->nlabels + 1) * sizeof(char *))) == NULL) {
+    fprintf(stderr, "seg_tab_label() -- cannot allocate %lu bytes\n", (unsigned long)((p->nlabels + 1) * sizeof(char *)));
+    return(-1);
+  }
+  p->label = label;
+
+  if ((p->label[i] = strdup(str)) == NULL) {
+    fprintf(stderr, "seg_tab_label() -- cannot allocate label %s\n", str);
+    return(-1);
+  }
+
+  p->nlabels++;
+
+  return(i);
+}
+
+/* ------------------------------------------------------------------------ */
+/* ----- segrec_t *seg_tab_append(segtab_t *, aseg_pos_t, aseg_pos_t, ----- */
+/* -----                          unsigned short, float)             ----- */
+/* ------------------------------------------------------------------------ */
+/*
+ * Append a segment to the table. Return its address, valid until the
+ * next append, or NULL in case of error.
+ */
+segrec_t *seg_tab_append(segtab_t *p, aseg_pos_t st, aseg_pos_t et, unsigned short label, float score)
+{
+  segrec_t *q;
+  unsigned long m;
+
+  if (p->n == p->m) {
+    m = (p->m) ? (2 * p->m) : (SEG_TAB_BLOCK);
+    if ((q = (segrec_t *)realloc(p->seg, m * sizeof(segrec_t))) == NULL) {
+      fprintf(stderr, "seg_tab_append() -- cannot allocate %lu segments\n", m);
+      return(NULL);
+    }
+    p->seg = q;
+    p->m = m;
+  }
+
+  q = p->seg + p->n;
+  q->st = st;
+  q->et = et;
+  q->label = label;
+  q->score = score;
+
+  p->n++;
+
+  return(q);
+}
+
+/* -------------------------------------------------------------- */
+/* ----- static int seg_rec_cmp(const void *, const void *) ----- */
+/* -------------------------------------------------------------- */
+static int seg_rec_cmp(const void *a, const void *b)
+{
+  const segrec_t *p = (const segrec_t *)a, *q = (const segrec_t *)b;
+
+  if (p->st != q->st)
+    return((p->st < q->st) ? (-1) : (1));
+  if (p->et != q->et)
+    return((p->et < q->et) ? (-1) : (1));
+
+  return(0);
+}
+
+/* ----------------------------------------- */
+/* ----- void seg_tab_sort(segtab_t *) ----- */
+/* ----------------------------------------- */
+void seg_tab_sort(segtab_t *p)
+{
+  if (p->n > 1)
+    qsort(p->seg, p->n, sizeof(segrec_t), seg_rec_cmp);
+}
+
+/* --------------------------------------------------------------- */
+/* ----- unsigned long seg_tab_merge(segtab_t *, aseg_pos_t) ----- */
+/* --------------------------------------------------------------- */
+/*
+ * Merge each segment of a sorted table with the previous one if they
+ * have the same label and are at most gap samples apart (overlapping
+ * segments included). The merged segment keeps the best score. Return
+ * the new number of segments.
+ */
+unsigned long seg_tab_merge(segtab_t *p, aseg_pos_t gap)
+{
+  segrec_t *q, *r;
+  unsigned long i;
+
+  if (p->n == 0)
+    return(0);
+
+  for (i = 1, q = p->seg; i < p->n; i++) {
+    r = p->seg + i;
+    if (r->label == q->label && r->st <= q->et + gap) {
+      if (r->et > q->et)
+	q->et = r->et;
+      if (r->score > q->score)
+	q->score = r->score;
+    }
+    else if (++q != r)
+      *q = *r;
+  }
+
+  p->n = (unsigned long)(q - p->seg) + 1;
+
+  return(p->n);
+}
+
+/* ----------------------------------------------------------- */
+/* ----- long seg_tab_find(const segtab_t *, aseg_pos_t) ----- */
+/* ----------------------------------------------------------- */
+/*
+ * Return the index of the segment of a sorted, non overlapping table
+ * containing sample pos, or -1 if pos falls outside all segments.
+ */
+long seg_tab_find(const segtab_t *p, aseg_pos_t pos)
+{
+  unsigned long lo = 0, hi = p->n, mid;
+
+  /* last segment starting at or before pos */
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (p->seg[mid].st <= pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == 0 || pos >= p->seg[lo-1].et)
+    return(-1);
+
+  return((long)(lo - 1));
+}
+
+/* ------------------------------------------------------------- */
+/* ----- segtab_t *seg_list_to_tab(const asseg_t *, float) ----- */
+/* ------------------------------------------------------------- */
+/*
+ * Convert a segment list to a table, rounding times to the nearest
+ * sample. A null start time stands for the first sample and a null
+ * end time for an empty segment. Return NULL in case of error.
+ */
+segtab_t *seg_list_to_tab(const asseg_t *seg, float Fs)
+{
+  segtab_t *tab;
+  const asseg_t *p;
+  aseg_pos_t st, et;
+  char *str, *c;
+  size_t len;
+  unsigned short i;
+  int label;
+
+  if ((tab = seg_tab_alloc(Fs)) == NULL)
+    return(NULL);
+
+  for (p = seg; p; p = p->next) {
+
+    /* label string, names separated by '+' */
+    len = 1;
+    for (i = 0; p->label && i < get_seg_num_labels(p); i++)
+      len += strlen(get_seg_label_name(p, i)) + 1;
+    if ((str = (char *)malloc(len)) == NULL) {
+      fprintf(stderr, "seg_list_to_tab() -- cannot allocate %lu bytes\n", (unsigned long)len);
+      seg_tab_free(tab);
+      return(NULL);
+    }
+    for (c = str, i = 0; p->label && i < get_seg_num_labels(p); i++) {
+      if (i)
+	*c++ = '+';
+      strcpy(c, get_seg_label_name(p, i));
+      c += strlen(c);
+    }
+    *c = 0x00;
+
+    label = seg_tab_label(tab, str);
+    free(str);
+
+    st = (get_seg_start_time(p) == ASEG_NULL_TIME) ? (0) : (aseg_pos_t)(get_seg_start_time(p) * (double)Fs + 0.5);
+    et = (get_seg_end_time(p) == ASEG_NULL_TIME) ? (st) : (aseg_pos_t)(get_seg_end_time(p) * (double)Fs + 0.5);
+
+    if (label < 0 || seg_tab_append(tab, st, et, (unsigned short)label, get_seg_score(p)) == NULL) {
+      seg_tab_free(tab);
+      return(NULL);
+    }
+  }
+
+  return(tab);
+}
+
+/* ------------------------------------------------------ */
+/* ----- asseg_t *seg_tab_to_list(const segtab_t *) ----- */
+/* ------------------------------------------------------ */
+/*
+ * Convert a table to a segment list. Return the first segment or NULL
+ * if the table is empty or in case of error.
+ */
+asseg_t *seg_tab_to_list(const segtab_t *tab)
+{
+  asseg_t *seg = NULL, *p, *prev = NULL;
+  const segrec_t *q;
+  unsigned long i;
+
+  for (i = 0, q = tab->seg; i < tab->n; i++, q++) {
+
+    p = seg_create(tab->label[q->label], (float)(q->st / (double)tab->Fs), (float)(q->et / (double)tab->Fs), q->score);
+
+    if (p == NULL) {
+      seg_list_free(seg);
+      return(NULL);
+    }
+
+    if (prev) {
+      p->prev = prev;
+      prev->next = p;
+    }
+    else
+      seg = p;
+
+    prev = p;
+  }
+
+  return(seg);
+}
+
+/* --------------------------------------------------------------------------- */
+/* ----- int seg_tab_write(const segtab_t *, const char *, const char *) ----- */
+/* --------------------------------------------------------------------------- */
+/*
+ * Write a segment table to file, in the seg_write() format. Return the
+ * number of segments written to file.
+ */
+int seg_tab_write(const segtab_t *tab, const char *fn, const char *format)
+{
+  FILE *f;
+  const segrec_t *q;
+  const char *c;
+  unsigned long i;
+  int nwritten = 0;
+
+  if (fn) {
+    if (strcmp(fn, "-") == 0)
+      f = stdout;
+    else if ((f = fopen(fn, "w")) == NULL) {
+      fprintf(stderr, "seg_tab_write() -- cannot open output file %s\n", fn);
+      return(0);
+    }
+  }
+  else
+    f = stdout;
+
+  for (i = 0, q = tab->seg; i < tab->n; i++, q++) {
+    if (format == NULL || strchr(format, 'l') || strchr(format, 'L'))
+      for (c = tab->label[q->label]; *c; c++)
+	fputc((*c == '+') ? '-' : *c, f);
+    if (format == NULL || strchr(format, 's') || strchr(format, 'S'))
+      fprintf(f, " %-.5f", q->st / (double)tab->Fs);
+    if (format == NULL || strchr(format, 'e') || strchr(format, 'E'))
+      fprintf(f, " %-.5f", q->et / (double)tab->Fs);
+    if ( (format == NULL || strchr(format, 'p') || strchr(format, 'P')) && q->score != ASEG_NULL_SCORE )
+      fprintf(f, " %e", q->score);
+    fprintf(f, "\n");
+
+    nwritten++;
+  }
+
+  if (f != stdout)
+    fclose(f);
+
+  return(nwritten);
+}
+
+#undef _segtab_c_
@@ -73,6 +73,21 @@
 #ifdef SPHERE
 # include <sp/sphere.h>
 #endif
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+/* SSE2 is part of the x86-64 base instruction set */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define SIG_SSE2 1
+# include <emmintrin.h>
+#endif
 
 /* --------------------------------------------- */
 /* ----- spsig_t *sig_alloc(unsigned long) ----- */
@@ -127,7 +142,8 @@ sigbuf_t *sig_buf_alloc(size_t nbytes, int nbps)
   if ((p = (sigbuf_t *)malloc(sizeof(sigbuf_t))) == NULL)
     return(NULL);
   
-  if ((p->s = (short *)malloc(nbytes)) == NULL) {
+  p->s = NULL; /* no storage for buffers pointing to mapped samples */
+  if (nbytes && (p->s = (short *)malloc(nbytes)) == NULL) {
     free(p);
     return(NULL);
   }
@@ -170,6 +186,11 @@ void sig_buf_free(sigbuf_t *p)
  *
  * SPRO_SIG_SPHERE_FORMAT -- NIST SPHERE file format (if compiled with
  * -DSPHERE) 
+ *
+ * SPRO_SIG_MMAP_FORMAT -- WAVE file whose data chunk is mapped read-only
+ * in memory. The whole data chunk is handed out as a single buffer by
+ * sig_stream_read() so that frames are read in place, without any
+ * intermediate copy (no byte swapping in this mode).
  */
 sigstream_t *sig_stream_open(const char *fn, int format, float Fs, size_t nbytes, int swap)
 {
@@ -189,10 +210,16 @@ sigstream_t *sig_stream_open(const char *fn, int format, float Fs, size_t nbytes
   p->format = format;
   p->nsamples = 0;
   p->nread = 0;
+  p->nfread = 0;
   p->Fs = Fs;
   p->nchannels = 0;
   p->nbps = 0;
   p->swap = swap;
+  p->map = NULL;
+  p->maplen = 0;
+  p->dataoff = 0;
+  p->bp = 0;
+  p->prev = 0.0;
   
   /* set stream filename */
   if (fn && strcmp(fn, "-") != 0)
@@ -211,6 +238,11 @@ sigstream_t *sig_stream_open(const char *fn, int format, float Fs, size_t nbytes
     status = sig_wave_stream_init(p, name);
     break;
     
+  case SPRO_SIG_MMAP_FORMAT:
+    status = sig_mmap_stream_init(p, name);
+    nbytes = 0;
+    break;
+    
 #ifdef SPHERE
   case SPRO_SIG_SPHERE_FORMAT:
     status = sig_sphere_stream_init(p, name);
@@ -235,6 +267,7 @@ sigstream_t *sig_stream_open(const char *fn, int format, float Fs, size_t nbytes
     sig_stream_close(p);
     return(NULL);
   }
+  p->buf->m -= p->buf->m % p->nchannels; /* whole sample frames only */
 
   return(p);
 }
@@ -256,6 +289,10 @@ void sig_stream_close(sigstream_t *p)
 	fclose(p->f);
       break;
 
+    case SPRO_SIG_MMAP_FORMAT:
+      sig_mmap_stream_close(p);
+      break;
+
 #ifdef SPHERE
     case SPRO_SIG_SPHERE_FORMAT:
       sp_close(p->f);
@@ -294,6 +331,10 @@ unsigned long sig_stream_read(sigstream_t *f)
       nread = sig_wave_stream_read(f);
       break;
 
+    case SPRO_SIG_MMAP_FORMAT:
+      nread = sig_mmap_stream_read(f);
+      break;
+
 #ifdef SPHERE
     case SPRO_SIG_SPHERE_FORMAT:
       nread = sig_sphere_stream_read(f);
@@ -336,6 +377,13 @@ int sig_pcm16_stream_init(sigstream_t *f, const char *fn)
   f->nchannels = 1;
   f->nbps = 2;
 
+  /* length of regular files, left unknown (0) for pipes */
+  if (fn && fseek(f->f, 0, SEEK_END) == 0) {
+    if (ftell(f->f) > 0)
+      f->nsamples = (unsigned long long)ftell(f->f) / f->nbps;
+    fseek(f->f, 0, SEEK_SET);
+  }
+
   return(0);
 }
 
@@ -349,20 +397,160 @@ int sig_pcm16_stream_init(sigstream_t *f, const char *fn)
  */
 unsigned long sig_pcm16_stream_read(sigstream_t *f)
 {
-  short *p = f->buf->s;
-  unsigned long nread, i;
+  unsigned long nread;
 
   nread = fread(f->buf->s, f->nbps, f->buf->m, f->f);
+  f->nfread++;
   
   if (f->swap)
-    for (i = 0; i < nread; i++, p++)
-      sp_swap(p+i, f->nbps);
+    sig_swap(f->buf->s, nread, f->nbps);
 
   f->buf->n = nread;
 
   return(nread / f->nchannels);
 }
 
+/* -------------------------------------------------------- */
+/* ----- static int skip_bytes(FILE *, unsigned long) ----- */
+/* -------------------------------------------------------- */
+/*
+ * Skip n bytes of an input stream, reading them for pipes. Return 0 if ok.
+ */
+static int skip_bytes(FILE *f, unsigned long n)
+{
+  char buf[512];
+  size_t k;
+
+  if (n > sizeof(buf) && n <= 0x7FFFFFFFUL && fseek(f, (long)n, SEEK_CUR) == 0)
+    return(0);
+
+  for (; n; n -= (unsigned long)k) {
+    k = (n < sizeof(buf)) ? (size_t)n : sizeof(buf);
+    if (fread(buf, 1, k, f) != k)
+      return(SPRO_SIG_READ_ERR);
+  }
+
+  return(0);
+}
+
+/* -------------------------------------------------------------------------- */
+/* ----- static unsigned long long le_bytes(const unsigned char *, int) ----- */
+/* -------------------------------------------------------------------------- */
+/*
+ * Decode an n bytes little endian unsigned integer.
+ */
+static unsigned long long le_bytes(const unsigned char *b, int n)
+{
+  unsigned long long v = 0;
+
+  while (n--)
+    v = (v << 8) | b[n];
+
+  return(v);
+}
+
+/* ------------------------------------------------------- */
+/* ----- int sig_wave_header(FILE *, sigwavehdr_t *) ----- */
+/* ------------------------------------------------------- */
+/*
+ * Read a WAVE header from the current position of f (the beginning of
+ * the file) up to the first sample, walking the RIFF chunks: the fmt
+ * chunk may be longer than 16 bytes (WAVE_FORMAT_EXTENSIBLE, whose sub
+ * format is returned as the format tag) and any other chunk (LIST,
+ * fact, bext, ...) before the data chunk is skipped. Chunks are read
+ * sequentially, so that pipes are fine. The header fields are decoded
+ * byte by byte (little endian) since the size of a long depends on the
+ * platform. Return 0 if ok.
+ *
+ * RF64 and BW64 files, i.e. WAVE files over 4 GB, are read as well:
+ * their 32 bits data chunk size is then -1 and the actual 64 bits size
+ * is taken from the ds64 chunk (EBU Tech 3306, ITU-R BS.2088).
+ */
+int sig_wave_header(FILE *f, sigwavehdr_t *h)
+{
+  unsigned char b[40];
+  unsigned long size, n;
+  unsigned long long size64 = 0;
+  int fmt = 0, rf64;
+
+  if (fread(b, 1, 12, f) != 12 || strncmp((char *)b+8, "WAVE", 4))
+    return(SPRO_SIG_READ_ERR);
+  rf64 = (strncmp((char *)b, "RF64", 4) == 0 || strncmp((char *)b, "BW64", 4) == 0);
+  if (! rf64 && strncmp((char *)b, "RIFF", 4))
+    return(SPRO_SIG_READ_ERR);
+  h->dataoff = 12;
+
+  while (fread(b, 1, 8, f) == 8) {
+
+    size = (unsigned long)le_bytes(b+4, 4);
+    h->dataoff += 8;
+
+    if (strncmp((char *)b, "data", 4) == 0) {
+      if (! fmt)
+	return(SPRO_SIG_READ_ERR);
+      h->datasize = (rf64 && size == 0xFFFFFFFFUL) ? (size64) : (size);
+      return(0);
+    }
+
+    n = 0;
+    if (strncmp((char *)b, "fmt ", 4) == 0) {
+      if (size < 16)
+	return(SPRO_SIG_READ_ERR);
+      n = (size < sizeof(b)) ? (size) : (sizeof(b));
+      if (fread(b, 1, n, f) != n)
+	return(SPRO_SIG_READ_ERR);
+      h->format = (unsigned short)le_bytes(b, 2);
+      h->nchannels = (unsigned short)le_bytes(b+2, 2);
+      h->Fs = (unsigned long)le_bytes(b+4, 4);
+      h->blockalign = (unsigned short)le_bytes(b+12, 2);
+      h->nbits = (unsigned short)le_bytes(b+14, 2);
+      if (h->format == SPRO_WAVE_FORMAT_EXTENSIBLE && n >= 26)
+	h->format = (unsigned short)le_bytes(b+24, 2);
+      fmt = 1;
+    }
+    else if (rf64 && strncmp((char *)b, "ds64", 4) == 0) {
+      /* RIFF size, data size and sample count, 64 bits each, then a table */
+      if (size < 24)
+	return(SPRO_SIG_READ_ERR);
+      n = 24;
+      if (fread(b, 1, n, f) != n)
+	return(SPRO_SIG_READ_ERR);
+      size64 = le_bytes(b+8, 8);
+    }
+
+    /* rest of the chunk, plus the pad byte of odd sized chunks */
+    if (skip_bytes(f, size - n + (size & 1)))
+      return(SPRO_SIG_READ_ERR);
+    h->dataoff += size + (size & 1);
+  }
+
+  return(SPRO_SIG_READ_ERR);
+}
+
+/* ------------------------------------------------------------------------ */
+/* ----- static int wave_stream_format(sigstream_t *, sigwavehdr_t *) ----- */
+/* ------------------------------------------------------------------------ */
+/*
+ * Set the stream description from a WAVE header. PCM samples of 1 to
+ * 4 bytes are supported, whatever the number of channels. Return 0 if
+ * ok.
+ */
+static int wave_stream_format(sigstream_t *f, sigwavehdr_t *h)
+{
+  if (h->format != SPRO_WAVE_FORMAT_PCM || h->nchannels == 0 || h->blockalign == 0 || h->blockalign % h->nchannels || h->blockalign / h->nchannels > 4) {
+    fprintf(stderr, "sig_stream_open(): unsupported WAVE format in stream %s\n", (f->name) ? (f->name) : "stdin");
+    return(SPRO_SIG_READ_ERR);
+  }
+
+  f->nchannels = h->nchannels;
+  f->nbps = h->blockalign / h->nchannels;
+  f->Fs = (float)h->Fs;
+  f->nsamples = h->datasize / h->blockalign; /* number of samples / channel */
+  f->dataoff = (size_t)h->dataoff;
+
+  return(0);
+}
+
 /* ----------------------------------------------------------------- */
 /* ----- int sig_wave_stream_init(sigstream_t *, const char *) ----- */
 /* ----------------------------------------------------------------- */
@@ -371,22 +559,7 @@ unsigned long sig_pcm16_stream_read(sigstream_t *f)
  */
 int sig_wave_stream_init(sigstream_t *f, const char *fn)
 {
-  struct {
-    char riff[4];                 /* String 'RIFF' without \0                */
-    long totsize;                 /* Total file size - 8                     */
-    char wave[4];                 /* String 'WAVE' without \0                */
-    char fmtstr[4];               /* String 'fmt_' without \0                */
-    long dum1;                    /* Length of format chunk (0x10)           */
-    short dum2;                   /* Always 0x01                             */
-    short numchans;               /* Number of channels                      */
-    long Fs;                      /* Sample rate (in Hz)                     */
-    long nbytespersec;            /* number of bytes/seconde                 */
-    short nbytespersample;        /* number of bytes/sample                  */
-    /* (1=8 bit mono, 2=8 bit stereo or 16 bit mono, 4= 16 bit stereo)   */
-    short nbitspersample;         /* number of bits/samples                  */
-    char data[4];                 /* string 'data' without \0                */
-    unsigned long datsize;        /* number of data bytes (not samples)      */
-  } hdr;
+  sigwavehdr_t hdr;
 
   /* open input file */
   if (fn) {
@@ -403,33 +576,13 @@ int sig_wave_stream_init(sigstream_t *f, const char *fn)
   else
     f->f = stdin;
   
-  /* read WAVE header */
-  if (fread(&hdr, sizeof(hdr), 1, f->f) != 1) {
-    fprintf(stderr, "sig_wave_stream_init(): cannot read WAVE header from %s\n", (fn) ? (fn) : "stdin");
-    return(SPRO_SIG_READ_ERR);
-  }
-  
-  if (f->swap) {
-    sp_swap(&(hdr.numchans), sizeof(short));
-    sp_swap1(&(hdr.Fs), sizeof(long));
-    sp_swap(&(hdr.nbytespersample), sizeof(short));
-    sp_swap1(&(hdr.datsize), sizeof(long));
-  }
-
-  if (strncmp(hdr.riff, "RIFF", 4) != 0 || strncmp(hdr.wave, "WAVE", 4)) {
+  /* read WAVE header, up to the first sample */
+  if (sig_wave_header(f->f, &hdr)) {
     fprintf(stderr, "sig_wave_stream_init(): stream %s not in WAVE format\n", (fn) ? (fn) : "stdin");
     return(SPRO_SIG_READ_ERR);
   }
 
-  /* set the value we are looking for */
-  f->nchannels = (unsigned short)hdr.numchans;
-  f->nbps = hdr.nbytespersample / hdr.numchans;
-  f->Fs = (float)hdr.Fs;
-  f->nsamples = (unsigned long)(hdr.datsize / hdr.nbytespersample); /* number of samples / channel */
-  
-  /* fprintf(stderr, "nchannels=%d  nbytespersample=%d  datasize=%ld\n", hdr.numchans, hdr.nbytespersample, hdr.datsize); */
-
-  return(0);
+  return(wave_stream_format(f, &hdr));
 }
 
 /* -------------------------------------------------------------- */
@@ -441,17 +594,16 @@ int sig_wave_stream_init(sigstream_t *f, const char *fn)
  */
 unsigned long sig_wave_stream_read(sigstream_t *f)
 {
-  short *p = f->buf->s;
-  unsigned long nread, n, i;
+  unsigned long nread, n;
 
   /* in wave format, the number of samples to read must be computed
      since there are some trailer (as opposed to header) data after
      the samples, so that we can't simply wait for the end of the
      input file! (though I suspect in most cases eof corresponds to
      the end of the input signal. */
-  n = (f->nsamples - f->nread) * f->nchannels;
-  if (n > f->buf->m)
-    n = f->buf->m;
+  n = f->buf->m;
+  if ((f->nsamples - f->nread) * f->nchannels < n)
+    n = (unsigned long)((f->nsamples - f->nread) * f->nchannels);
 
   /* Hi there! If you're reading this because you're trying to
      understand the warning below, here's an explanation! The function
@@ -459,18 +611,177 @@ unsigned long sig_wave_stream_read(sigstream_t *f)
      read less. This is probably because of a weird total number of
      samples read from the WAVE header and stored in
      f->nsamples. Check that! */
-  if ((nread = fread(f->buf->s, f->nbps, n, f->f)) != n)
+  if ((nread = fread(f->buf->s, f->nbps, n, f->f)) != n && f->name)
     fprintf(stderr, "[SPro warning] end of wave stream unexpected!\n");
+  f->nfread++;
 
-  if (f->swap && f->nbps > 1)
-    for (i = 0; i < nread; i++, p += f->nbps)
-      sp_swap(p, f->nbps);
+  if (f->swap)
+    sig_swap(f->buf->s, nread, f->nbps);
 
   f->buf->n = nread;;
 
   return(nread / f->nchannels);
 }
 
+/* ----------------------------------------------------------------- */
+/* ----- int sig_mmap_stream_init(sigstream_t *, const char *) ----- */
+/* ----------------------------------------------------------------- */
+/*
+ * Initialize stream for a memory mapped WAVE file. The header is read
+ * by sig_wave_header() and the whole file is mapped read-only.
+ */
+int sig_mmap_stream_init(sigstream_t *f, const char *fn)
+{
+  sigwavehdr_t hdr;
+  size_t len;
+  FILE *fp;
+  int status;
+#ifdef _WIN32
+  HANDLE hf, hm;
+  LARGE_INTEGER sz;
+#else
+  int fd;
+  struct stat sb;
+  void *m;
+#endif
+
+  if (fn == NULL) {
+    fprintf(stderr, "sig_mmap_stream_init(): cannot map stdin\n");
+    return(SPRO_STREAM_OPEN_ERR);
+  }
+
+  if (f->swap) {
+    fprintf(stderr, "sig_mmap_stream_init(): cannot swap samples of a mapped stream\n");
+    return(SPRO_BAD_PARAM_ERR);
+  }
+
+  if ((f->name = strdup(fn)) == NULL) {
+    fprintf(stderr, "sig_mmap_stream_init(): cannot set stream name %s\n", fn);
+    return(SPRO_ALLOC_ERR);
+  }
+
+  /* read WAVE header */
+  if ((fp = fopen(fn, "rb")) == NULL) {
+    fprintf(stderr, "sig_mmap_stream_init(): cannot open file %s\n", fn);
+    return(SPRO_SIG_READ_ERR);
+  }
+  status = sig_wave_header(fp, &hdr);
+  fclose(fp);
+
+  if (status) {
+    fprintf(stderr, "sig_mmap_stream_init(): stream %s not in WAVE format\n", fn);
+    return(SPRO_SIG_READ_ERR);
+  }
+
+  if (wave_stream_format(f, &hdr))
+    return(SPRO_SIG_READ_ERR);
+
+  /* map the file */
+#ifdef _WIN32
+  if ((hf = CreateFileA(fn, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE) {
+    fprintf(stderr, "sig_mmap_stream_init(): cannot open file %s\n", fn);
+    return(SPRO_SIG_READ_ERR);
+  }
+  if (! GetFileSizeEx(hf, &sz) || (unsigned __int64)sz.QuadPart > (size_t)-1) {
+    CloseHandle(hf);
+    fprintf(stderr, "sig_mmap_stream_init(): file %s too large to be mapped\n", fn);
+    return(SPRO_SIG_READ_ERR);
+  }
+  len = (size_t)sz.QuadPart;
+  hm = CreateFileMappingA(hf, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(hf);
+  if (hm == NULL) {
+    fprintf(stderr, "sig_mmap_stream_init(): cannot map file %s\n", fn);
+    return(SPRO_SIG_READ_ERR);
+  }
+  f->map = (char *)MapViewOfFile(hm, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(hm); /* the view keeps the mapping alive */
+  if (f->map == NULL) {
+    fprintf(stderr, "sig_mmap_stream_init(): cannot map file %s\n", fn);
+    return(SPRO_SIG_READ_ERR);
+  }
+#else
+  if ((fd = open(fn, O_RDONLY)) < 0) {
+    fprintf(stderr, "sig_mmap_stream_init(): cannot open file %s\n", fn);
+    return(SPRO_SIG_READ_ERR);
+  }
+  if (fstat(fd, &sb) != 0 || (unsigned long long)sb.st_size > (size_t)-1) {
+    close(fd);
+    fprintf(stderr, "sig_mmap_stream_init(): file %s too large to be mapped\n", fn);
+    return(SPRO_SIG_READ_ERR);
+  }
+  len = (size_t)sb.st_size;
+  m = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); /* the mapping stays valid */
+  if (m == MAP_FAILED) {
+    fprintf(stderr, "sig_mmap_stream_init(): cannot map file %s\n", fn);
+    return(SPRO_SIG_READ_ERR);
+  }
+  f->map = (char *)m;
+# ifdef MADV_SEQUENTIAL
+  madvise(m, len, MADV_SEQUENTIAL);
+# endif
+#endif
+  f->maplen = len;
+
+  /* trust the file size rather than a truncated or bogus data chunk size */
+  if (f->dataoff > len)
+    f->dataoff = len;
+  if (f->nsamples > (len - f->dataoff) / hdr.blockalign)
+    f->nsamples = (len - f->dataoff) / hdr.blockalign;
+
+  return(0);
+}
+
+/* -------------------------------------------------------------- */
+/* ----- unsigned long sig_mmap_stream_read(sigstream_t *) ------ */
+/* -------------------------------------------------------------- */
+/* 
+ * Point the buffer to the mapped samples not read yet. The rest of the
+ * data chunk is transfered at once, as long as its number of samples
+ * fits in the buffer size, so that a second call normally reaches the
+ * end of the stream. Return the number of samples per channel in the
+ * buffer.
+ */
+unsigned long sig_mmap_stream_read(sigstream_t *f)
+{
+  unsigned long long n = f->nsamples - f->nread;
+
+  if (f->nread >= f->nsamples) {
+    f->buf->n = 0;
+    return(0);
+  }
+
+  if (n > (unsigned long)-1 / f->nchannels)
+    n = (unsigned long)-1 / f->nchannels;
+
+  f->buf->s = (short *)(f->map + f->dataoff + (size_t)f->nread * f->nchannels * f->nbps);
+  f->buf->n = f->buf->m = (unsigned long)n * f->nchannels;
+
+  return((unsigned long)n);
+}
+
+/* ----------------------------------------------------- */
+/* ----- void sig_mmap_stream_close(sigstream_t *) ----- */
+/* ----------------------------------------------------- */
+/*
+ * Unmap the stream file. The buffer does not own the samples.
+ */
+void sig_mmap_stream_close(sigstream_t *f)
+{
+  if (f->buf)
+    f->buf->s = NULL;
+
+  if (f->map) {
+#ifdef _WIN32
+    UnmapViewOfFile(f->map);
+#else
+    munmap(f->map, f->maplen);
+#endif
+    f->map = NULL;
+  }
+}
+
 #ifdef SPHERE
 /* ------------------------------------------------------------------- */
 /* ----- int sig_sphere_stream_init(sigstream_t *, const char *) ----- */
@@ -525,13 +836,12 @@ int sig_sphere_stream_init(sigstream_t *f, const char *fn)
 unsigned long sig_sphere_stream_read(sigstream_t *f)
 {
   short *p = f->buf->s;
-  unsigned long nread, i;
+  unsigned long nread;
 
   nread = sp_read_data(p, f->buf->m / f->nchannels, f->f);
 
   if (f->swap) 
-    for (i = 0; i < nread; i++, p++)
-      sp_swap(p+i, sizeof(short));
+    sig_swap(p, nread * f->nchannels, sizeof(short));
 
   f->buf->n = nread * f->nchannels;
   
@@ -547,23 +857,23 @@ unsigned long sig_sphere_stream_read(sigstream_t *f)
  * Return 0 if no frames can be read and 1 otherwise.
  *
  * NOTE: the frame sample buffer s *must* be kept untouched between two successive calls.
+ * The reading position and the filter memory are kept in the stream.
  */
 int get_next_sig_frame(sigstream_t *f, int ch, int l, int d, float a, sample_t *s)
 {
-  static double prev = 0.0;     /* pre-emphasis filter memory               */
-  static unsigned long bp = 0;  /* current position in the stream buffer    */
   unsigned long nread;          /* number of samples read in buffer         */
+  unsigned long k;
   unsigned short i, j;
-  short *p;
   double v;
+  sig_conv_t conv;
 
-  /* channel sanity check */
-  if (ch < 1 || ch > f->nchannels)
+  /* channel sanity check, 0 standing for the mean of all the channels */
+  if (ch < 0 || ch > f->nchannels || (conv = sig_converter(f->nbps, f->nchannels, ch)) == NULL)
     return(0);
 
   if (f->nread == 0) { /* first call ==> we have to read completely the first frame */
-    bp = 0;
-    prev = 0.0;
+    f->bp = 0;
+    f->prev = 0.0;
     j = 0;
   }
   else /* next calls ==> reuse l-d samples and add d new samples */
@@ -571,25 +881,39 @@ int get_next_sig_frame(sigstream_t *f, int ch, int l, int d, float a, sample_t *
       *(s+j) = *(s+i);
 
   nread = 1; /* ugly trick to get into the while loop ;) */
-  p = f->buf->s + (ch - 1) * f->nbps;
 
   while (j < l && nread) {
 
-    if (bp == f->buf->n) { /* this means buffer is empty! */
+    if (f->bp == f->buf->n) { /* this means buffer is empty! */
       nread = sig_stream_read(f);
-      bp = 0;
+      f->bp = 0;
     }
-    
-    if (nread)
-      while (j < l && bp < f->buf->n) {
-	v = getsample(p, bp, f->nbps);
-	*(s+j) = (sample_t)(v - a * prev);
-	prev = v;
+
+    if (nread == 0) /* we failed to read additionnal samples */
+      return(0);
+
+    if (a == 0.0) {
+      /* no pre-emphasis: convert as many whole sample frames as possible at once */
+      k = (f->buf->n - f->bp) / f->nchannels;
+      if (k > (unsigned long)(l - j))
+	k = l - j;
+      if (k) {
+	conv((const char *)f->buf->s + (size_t)f->bp * f->nbps, k, f->nchannels, ch, s + j);
+	j += (unsigned short)k;
+	f->bp += k * f->nchannels;
+	f->prev = getchsample(f->buf->s, f->bp - f->nchannels, f->nbps, f->nchannels, ch);
+      }
+      else
+	f->bp = f->buf->n; /* truncated sample frame */
+    }
+    else
+      while (j < l && f->bp < f->buf->n) {
+	v = getchsample(f->buf->s, f->bp, f->nbps, f->nchannels, ch);
+	*(s+j) = (sample_t)(v - a * f->prev);
+	f->prev = v;
 	j++;
-	bp += f->nchannels;
+	f->bp += f->nchannels;
       }
-    else /* we failed to read additionnal samples */
-      return(0);
   }
 
   return(1);
@@ -599,26 +923,310 @@ int get_next_sig_frame(sigstream_t *f, int ch, int l, int d, float a, sample_t *
 /* ----- double getsample(void *, unsigned long, unsigned short) ----- */
 /* ------------------------------------------------------------------- */
 /*
- * Return n'th sample value assuming m bytes samples.
+ * Return n'th sample value assuming m bytes samples. As in WAVE files,
+ * 8 bits samples are unsigned and 24 bits samples little endian.
  */
 double getsample(short *p, unsigned long n, int m)
 {
-  double v;
+  unsigned char *b;
+  long v;
 
   switch(m) {
   case 1:
-    v = (double)(*((char *)p+n));
-    break;
+    return((double)*((unsigned char *)p+n) - 128.0);
   case 2:
-    v = (double)*((short *)p+n);
+    return((double)*((short *)p+n));
+  case 3:
+    b = (unsigned char *)p + 3 * n;
+    v = (long)b[0] | (long)b[1] << 8 | (long)b[2] << 16;
+    return((double)((v & 0x800000L) ? (v - 0x1000000L) : (v)));
+  case 4:
+    return((double)*((int *)p+n));
+  }
+
+  return(0.0);
+}
+
+/* --------------------------------------------------------------------------- */
+/* ----- double getchsample(short *, unsigned long, int, unsigned short, ----- */
+/* -----                    int)                                         ----- */
+/* --------------------------------------------------------------------------- */
+/*
+ * Return the value of channel ch (starting at 1) of the sample frame
+ * starting at the n'th sample of a buffer of nch interleaved channels
+ * of m bytes samples, or the mean of all the channels if ch is 0.
+ */
+double getchsample(short *p, unsigned long n, int m, unsigned short nch, int ch)
+{
+  double v = 0.0;
+  unsigned short k;
+
+  if (ch)
+    return(getsample(p, n + ch - 1, m));
+
+  for (k = 0; k < nch; k++)
+    v += getsample(p, n + k, m);
+
+  return(v / nch);
+}
+
+/*
+ * Sample frame converters.
+ *
+ * getchsample() switches on the sample width, and loops over the
+ * channels, for every single sample. The converters below are
+ * generated for each sample width (SIG_CONVERTERS) in three flavours:
+ * mono, one channel out of nch interleaved ones, and the mean of the
+ * nch channels. sig_converter() picks one once per block of frames, so
+ * that the inner loops have no branch but the loop test. Values are
+ * those of getchsample(): each sample is converted to double, the
+ * channels are summed in order and divided by nch, and the result is
+ * rounded once to sample_t.
+ */
+
+/* value of the sample at b, as getsample() returns it */
+#define SIG_S8(b)  ((double)*(b) - 128.0)
+#define SIG_S16(b) ((double)*(const short *)(b))
+#define SIG_S24(b) ((double)((((long)(b)[0] | (long)(b)[1] << 8 | (long)(b)[2] << 16) ^ 0x800000L) - 0x800000L))
+#define SIG_S32(b) ((double)*(const int *)(b))
+
+#define SIG_CONVERTERS(m, get)                                                        \
+static void sig_mono##m(const char *p, unsigned long n, unsigned short nch, int ch, sample_t *s) \
+{                                                                                     \
+  const unsigned char *b = (const unsigned char *)p;                                  \
+  unsigned long i;                                                                    \
+                                                                                      \
+  (void)nch;                                                                          \
+  (void)ch;                                                                           \
+  for (i = 0; i < n; i++, b += m)                                                     \
+    *(s+i) = (sample_t)get(b);                                                        \
+}                                                                                     \
+                                                                                      \
+static void sig_chan##m(const char *p, unsigned long n, unsigned short nch, int ch, sample_t *s) \
+{                                                                                     \
+  const unsigned char *b = (const unsigned char *)p + (size_t)m * (ch - 1);           \
+  size_t step = (size_t)m * nch;                                                      \
+  unsigned long i;                                                                    \
+                                                                                      \
+  for (i = 0; i < n; i++, b += step)                                                  \
+    *(s+i) = (sample_t)get(b);                                                        \
+}                                                                                     \
+                                                                                      \
+static void sig_mean##m(const char *p, unsigned long n, unsigned short nch, int ch, sample_t *s) \
+{                                                                                     \
+  const unsigned char *b = (const unsigned char *)p;                                  \
+  unsigned long i;                                                                    \
+  unsigned short k;                                                                   \
+  double v;                                                                           \
+                                                                                      \
+  (void)ch;                                                                           \
+  for (i = 0; i < n; i++) {                                                           \
+    for (k = 0, v = 0.0; k < nch; k++, b += m)                                        \
+      v += get(b);                                                                    \
+    *(s+i) = (sample_t)(v / nch);                                                     \
+  }                                                                                   \
+}
+
+SIG_CONVERTERS(1, SIG_S8)
+SIG_CONVERTERS(2, SIG_S16)
+SIG_CONVERTERS(3, SIG_S24)
+SIG_CONVERTERS(4, SIG_S32)
+
+static const sig_conv_t sig_conv[3][4] = {
+  {sig_mono1, sig_mono2, sig_mono3, sig_mono4},
+  {sig_chan1, sig_chan2, sig_chan3, sig_chan4},
+  {sig_mean1, sig_mean2, sig_mean3, sig_mean4}
+};
+
+/* -------------------------------------------------------------- */
+/* ----- sig_conv_t sig_converter(int, unsigned short, int) ----- */
+/* -------------------------------------------------------------- */
+/*
+ * Return the converter of channel ch (from 1, 0 for the mean) of m
+ * bytes samples with nch channels, or NULL if not supported.
+ */
+sig_conv_t sig_converter(int m, unsigned short nch, int ch)
+{
+  if (m < 1 || m > 4 || nch == 0 || ch < 0 || ch > nch)
+    return(NULL);
+
+  return(sig_conv[(nch == 1) ? (0) : (ch) ? (1) : (2)][m-1]);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----- sigframes_t *sig_frames_open(sigstream_t *, int, unsigned short, ----- */
+/* -----                             unsigned short)                     ----- */
+/* ------------------------------------------------------------------------- */
+/*
+ * Open views on the frames of l samples every d samples of channel ch
+ * (from 1, 0 for the mean) of stream f, as get_next_sig_frame() would
+ * return them without pre-emphasis. The samples are converted once
+ * into a buffer of SIG_FRAMES_BLOCK samples beyond a frame, and
+ * sig_frames_next() hands out pointers into it: overlapping samples
+ * are neither copied nor converted again, and only the part of a frame
+ * left at the end of the buffer is moved back to its start, once per
+ * buffer. The stream must not be read by other means meanwhile.
+ */
+sigframes_t *sig_frames_open(sigstream_t *f, int ch, unsigned short l, unsigned short d)
+{
+  sigframes_t *p;
+  sig_conv_t conv;
+
+  if (l == 0 || d == 0 || (conv = sig_converter(f->nbps, f->nchannels, ch)) == NULL) {
+    fprintf(stderr, "sig_frames_open(): invalid frame or stream parameters\n");
+    return(NULL);
+  }
+
+  if ((p = (sigframes_t *)malloc(sizeof(sigframes_t))) == NULL) {
+    fprintf(stderr, "sig_frames_open(): cannot allocate memory\n");
+    return(NULL);
+  }
+
+  p->m = (unsigned long)l + ((d > SIG_FRAMES_BLOCK) ? (d) : (SIG_FRAMES_BLOCK));
+  if ((p->r = (sample_t *)malloc(p->m * sizeof(sample_t))) == NULL) {
+    fprintf(stderr, "sig_frames_open(): cannot allocate memory\n");
+    free(p);
+    return(NULL);
+  }
+
+  p->f = f;
+  p->ch = ch;
+  p->l = l;
+  p->d = d;
+  p->conv = conv;
+  p->n = p->pos = p->skip = 0;
+  p->bp = f->bp; /* where get_next_sig_frame() left the stream buffer, if ever called */
+  p->view.n = l;
+  p->view.s = NULL;
+
+  return(p);
+}
+
+/* --------------------------------------------------------- */
+/* ----- const spsig_t *sig_frames_next(sigframes_t *) ----- */
+/* --------------------------------------------------------- */
+/*
+ * Return a view on the next frame, or NULL at the end of the stream
+ * (or on a read error). The view is valid until the next call and its
+ * samples must not be modified.
+ */
+const spsig_t *sig_frames_next(sigframes_t *p)
+{
+  sigstream_t *f = p->f;
+  unsigned long k;
+
+  if (p->pos + p->l > p->n) {
+
+    /* keep what is left of the next frame, drop what lies before it */
+    if (p->pos < p->n) {
+      memmove(p->r, p->r + p->pos, (p->n - p->pos) * sizeof(sample_t));
+      p->n -= p->pos;
+    }
+    else {
+      p->skip += p->pos - p->n;
+      p->n = 0;
+    }
+    p->pos = 0;
+
+    /* convert whole sample frames from the stream buffer, refilling it as needed */
+    while (p->n < p->m) {
+      if (p->bp >= f->buf->n) {
+	if (sig_stream_read(f) == 0)
+	  break;
+	p->bp = 0;
+      }
+      if ((k = (f->buf->n - p->bp) / f->nchannels) == 0) {
+	p->bp = f->buf->n; /* truncated sample frame */
+	continue;
+      }
+      if (p->skip) {
+	if (k > p->skip)
+	  k = p->skip;
+	p->skip -= k;
+      }
+      else {
+	if (k > p->m - p->n)
+	  k = p->m - p->n;
+	p->conv((const char *)f->buf->s + (size_t)p->bp * f->nbps, k, f->nchannels, p->ch, p->r + p->n);
+	p->n += k;
+      }
+      p->bp += k * f->nchannels;
+    }
+
+    if (p->n < p->l)
+      return(NULL);
+  }
+
+  p->view.s = p->r + p->pos;
+  p->pos += p->d;
+
+  return(&(p->view));
+}
+
+/* ------------------------------------------------ */
+/* ----- void sig_frames_close(sigframes_t *) ----- */
+/* ------------------------------------------------ */
+void sig_frames_close(sigframes_t *p)
+{
+  if (p) {
+    free(p->r);
+    free(p);
+  }
+}
+
+/* ------------------------------------------------------- */
+/* ----- void sig_swap(void *, unsigned long, size_t) ----- */
+/* ------------------------------------------------------- */
+/*
+ * Reverse the byte order of n samples of m bytes, in one pass over
+ * the whole buffer: 16 and 32 bits samples are swapped 16 bytes at a
+ * time with SSE2 shifts, the remaining ones with the same shifts on
+ * single words.
+ */
+void sig_swap(void *buf, unsigned long n, size_t m)
+{
+  unsigned long i = 0;
+  unsigned short *s = (unsigned short *)buf;
+  unsigned int *w = (unsigned int *)buf;
+  unsigned char c, *b = (unsigned char *)buf;
+#ifdef SIG_SSE2
+  __m128i x;
+#endif
+
+  switch (m) {
+  case 2:
+#ifdef SIG_SSE2
+    for (; i + 8 <= n; i += 8) {
+      x = _mm_loadu_si128((const __m128i *)(s + i));
+      x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+      _mm_storeu_si128((__m128i *)(s + i), x);
+    }
+#endif
+    for (; i < n; i++)
+      s[i] = (unsigned short)(s[i] >> 8 | s[i] << 8);
+    break;
+  case 3:
+    for (; i < n; i++, b += 3) {
+      c = b[0]; b[0] = b[2]; b[2] = c;
+    }
     break;
   case 4:
-    v = (double)*((long *)p+n);
+#ifdef SIG_SSE2
+    for (; i + 4 <= n; i += 4) {
+      x = _mm_loadu_si128((const __m128i *)(w + i));
+      x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xB1), 0xB1);
+      x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+      _mm_storeu_si128((__m128i *)(w + i), x);
+    }
+#endif
+    for (; i < n; i++)
+      w[i] = w[i] >> 24 | (w[i] >> 8 & 0xFF00U) | (w[i] << 8 & 0xFF0000U) | w[i] << 24;
+    break;
   default:
-    v = 0.0;
+    if (m > 1)
+      for (; i < n; i++, b += m)
+        sp_swap((short *)b, m);
   }
-
-  return(v);
 }
 
 /* ---------------------------------------- */
@@ -163,6 +163,7 @@ spfbuf_t *spf_buf_alloc(unsigned short dim, size_t nbytes)
   if ((p = (spfbuf_t *)malloc(sizeof(spfbuf_t))) != NULL) {
 
     p->n = p->m = 0;
+    p->nresize = 0;
     p->dim = p->adim = 0;
     p->s = (spf_t *)NULL;
 
@@ -206,8 +207,15 @@ void spf_buf_free(spfbuf_t *p)
  */
 spf_t *spf_buf_resize(spfbuf_t *p, unsigned long n)
 {
-  if ((p->s = (spf_t*)realloc(p->s, n * p->adim * sizeof(spf_t))) != NULL)
-    p->m = n;
+  spf_t *s;
+
+  /* on failure, the buffer is left as is */
+  if ((s = (spf_t*)realloc(p->s, n * p->adim * sizeof(spf_t))) == NULL)
+    return(NULL);
+
+  p->s = s;
+  p->m = n;
+  p->nresize++;
 
   return(p->s);
 }
@@ -217,9 +225,13 @@ spf_t *spf_buf_resize(spfbuf_t *p, unsigned long n)
 /* ------------------------------------------------------------------------------------- */
 /*
  * Append feature vector to buffer -- if buffer is full and resize block 
- * size (nmore) is not null, increment buffer size by nmore, otherwise 
+ * size (nmore) is not null, increment buffer size by at least nmore, otherwise 
  * returns an error. Returns a pointer to the appended vector in the 
  * buffer or NULL in case of error.
+ *
+ * The buffer grows by half its size when this is more than nmore, so
+ * that filling a buffer of n vectors costs O(log n) reallocations and
+ * copies rather than n / nmore of them.
  */
 spf_t *spf_buf_append(spfbuf_t *buf, spf_t *s, unsigned short dim, unsigned long nmore)
 {
@@ -248,6 +260,8 @@ spf_t *spf_buf_append(spfbuf_t *buf, spf_t *s, unsigned short dim, unsigned long
       *(p+j) = *(s+j);
   }
   else if (nmore) {
+    if (nmore < buf->m / 2)
+      nmore = buf->m / 2;
     if (spf_buf_resize(buf, buf->m + nmore) == NULL) {
       fprintf(stderr, "spf_buf_append(): cannot extend buffer\n");
       return(NULL);
@@ -17,85 +17,151 @@
 #define _ssad_c_
 
 #include "ssad.h"
+#include "mthread.h"
+
+static int bigauss_em(spfbuf_t *, bigauss_hist_t *, bigauss_t *, int, double, int);
+
+#define SSAD_CHUNK_MIN 6000       /* minimum number of frames per chunk       */
+#define SSAD_PROFILE_BLOCK 10000  /* profile growth for unknown length inputs */
+
+typedef struct {
+  ssad_ctx_t *ctx;                /* detector settings                        */
+  sigstream_t *s;                 /* mapped input stream                      */
+  unsigned short l, d;            /* frame length and shift                   */
+  unsigned long fs, fe;           /* first and last+1 frame of the chunk      */
+  spf_t *e;                       /* energies of frames fs to fe-1            */
+  double emin, emax;              /* chunk energy range                       */
+  int status;                     /* 0 if ok                                  */
+} ssad_chunk_t;
+
+/* -------------------------------------------- */
+/* ----- void ssad_ctx_init(ssad_ctx_t *) ----- */
+/* -------------------------------------------- */
+/*
+ * Set the detector parameters to their default values.
+ */
+void ssad_ctx_init(ssad_ctx_t *ctx)
+{
+  ctx->channel = 1;
+  ctx->st = 0.0;
+  ctx->et = ASEG_NULL_TIME;
+  ctx->fm_l = 20.0;
+  ctx->fm_d = 10.0;
+  ctx->win = 0;
+  ctx->threshold = 0.0;
+  ctx->minlen = 0.5;
+  ctx->ofmt = SPEECH;
+  ctx->uselog = 1;
+  ctx->nthreads = 0;
+  ctx->nbins = 0;
+  ctx->warmup = 30.0;
+  ctx->lookahead = 0.0;
+  ctx->halflife = 0.0;
+  ctx->stats = NULL;
+}
 
-/* ----------------------------------------------- */
-/* ----- global variables set by read_args() ----- */
-/* ----------------------------------------------- */
-int channel = 1;
-float st = 0.0;                   /* start and end times                      */
-float et = ASEG_NULL_TIME;
-float fm_l = 20.0;                /* frame length in ms                       */
-float fm_d = 10.0;                /* frame shift in ms                        */
-int win = 0;                      /* weighting window                         */
-float threshold = 0.0;            /* deviation w.r.t. standard deviation      */
-float minlen = 0.5;               /* minimum silence segment length           */
-int ofmt = SPEECH;               /* output format                            */
-int uselog = 1;                   /* use log-energy rather than energy        */
-
-/* ----------------------------------------------------- */
-/* ----- asseg_t *silence_detection(sigstream_t *) ----- */
-/* ----------------------------------------------------- */
+/* -------------------------------------------------------------------- */
+/* ----- segtab_t *silence_detection(ssad_ctx_t *, sigstream_t *) ----- */
+/* -------------------------------------------------------------------- */
 /*
  * process input file.
  */
-asseg_t *silence_detection(sigstream_t *s)
+segtab_t *silence_detection(ssad_ctx_t *ctx, sigstream_t *s)
 {
   bigauss_t bg;
+  bigauss_hist_t *h;
   spfbuf_t *e;
-  asseg_t *seg;
+  segtab_t *seg;
   unsigned short nl, nd;
-  double emin, emax;
-
-  spfbuf_t *get_energy_profile(sigstream_t *, unsigned short, unsigned short, double *, double *);
-  void init_bigauss(bigauss_t *, double, double);
-  void buf_to_bigauss(spfbuf_t *, bigauss_t *, int, double);
-  asseg_t *profile_to_seg(spfbuf_t *, bigauss_t *, float);
+  double emin, emax, t;
+  int niter;
 
-  nl = (unsigned short)(fm_l * s->Fs / 1000.0);
-  nd = (unsigned short)(fm_d * s->Fs / 1000.0);
+  nl = (unsigned short)(ctx->fm_l * s->Fs / 1000.0);
+  nd = (unsigned short)(ctx->fm_d * s->Fs / 1000.0);
 
-  if ((e = get_energy_profile(s, nl, nd, &emin, &emax)) == NULL)
+  t = mwstats_clock(ctx->stats);
+  if ((e = get_energy_profile(ctx, s, nl, nd, &emin, &emax)) == NULL)
     return(NULL);
+  mwstats_stage(ctx->stats, MWSTATS_PROFILE, t);
 
+  /* a mapped stream is read whole, by chunks, rather than through its buffer */
+  MWSTATS_ADD(ctx->stats, nbytes_read, (sig_stream_map_data(s)) ? (unsigned long long)sig_stream_map_size(s) : (s->nread * s->nchannels * s->nbps));
+  MWSTATS_ADD(ctx->stats, nfread, s->nfread);
+  MWSTATS_ADD(ctx->stats, nresize, e->nresize);
+
+  t = mwstats_clock(ctx->stats);
   init_bigauss(&bg, emin, emax);
-  buf_to_bigauss(e, &bg, 20, 0.0001);
+  if (ctx->nbins) {
+    if ((h = bigauss_hist(e, emin, emax, ctx->nbins)) == NULL) {
+      spf_buf_free(e);
+      return(NULL);
+    }
+    niter = hist_to_bigauss(h, &bg, 20, 0.0001);
+    bigauss_hist_free(h);
+  }
+  else
+    niter = buf_to_bigauss(e, &bg, 20, 0.0001, ctx->nthreads);
+  MWSTATS_ADD(ctx->stats, niter, niter);
+  mwstats_stage(ctx->stats, MWSTATS_EM, t);
 
   /* ----- convert profile to segmentation ----- */
-  if ((seg = profile_to_seg(e, &bg, nd / s->Fs)) == NULL) {
+  t = mwstats_clock(ctx->stats);
+  if ((seg = seg_tab_alloc(s->Fs)) == NULL || profile_to_seg(ctx, e, &bg, nd, s->Fs, seg)) {
     fprintf(stderr, "ssad error -- cannot create output segmentation\n");
-    spf_buf_free(e); seg_list_free(seg);
+    spf_buf_free(e); seg_tab_free(seg);
     return(NULL);
   }
+  mwstats_stage(ctx->stats, MWSTATS_SEG, t);
 
   spf_buf_free(e);
 
   return(seg);
 }
 
-/* ---------------------------------------------------------------------------- */
-/* ----- spfbuf_t *get_energy_profile(sigstream_t *, unsigned short,      ----- */
-/* -----                              unsigned short, double *, double *) ----- */
-/* ---------------------------------------------------------------------------- */
+/* --------------------------------------------------------------------------------- */
+/* ----- static unsigned long first_frame(ssad_ctx_t *, float, unsigned short) ----- */
+/* --------------------------------------------------------------------------------- */
 /*
- * Compute signal stream energy profile.
+ * Index of the first frame of the profile, i.e. of the frame in which
+ * ctx->st falls. The profile, hence the segments, start at sample
+ * first_frame() * d.
  */
-spfbuf_t *get_energy_profile(sigstream_t *s, unsigned short l, unsigned short d, double *emin, double *emax)
+static unsigned long first_frame(ssad_ctx_t *ctx, float Fs, unsigned short d)
+{
+  return((unsigned long)(ctx->st * Fs / (float)d));
+}
+
+/* ------------------------------------------------------------------------ */
+/* ----- spfbuf_t *get_energy_profile(ssad_ctx_t *, sigstream_t *,    ----- */
+/* -----                              unsigned short, unsigned short, ----- */
+/* -----                              double *, double *)             ----- */
+/* ------------------------------------------------------------------------ */
+/*
+ * Compute signal stream energy profile. When the stream length is
+ * known, the profile is allocated once and for all. Otherwise (stdin),
+ * it grows geometrically from SSAD_PROFILE_BLOCK frames.
+ */
+spfbuf_t *get_energy_profile(ssad_ctx_t *ctx, sigstream_t *s, unsigned short l, unsigned short d, double *emin, double *emax)
 {
   spfbuf_t *buf;
   float *w = NULL;
-  //int i;
-  sample_t *sbuf;
-  spsig_t *frame;
+  sigframes_t *fr;
+  const spsig_t *v;
+  spsig_t *frame = NULL;
   spf_t e;
-  unsigned long n, nact, sn, en, nframes = 0;
+  unsigned long n, nact, sn, en, nframes = 0, nalloc;
+
+  /* ----- the whole signal is at hand: compute it by chunks ----- */
+  if (sig_stream_map_data(s))
+    return(get_energy_profile_chunked(ctx, s, l, d, emin, emax));
 
   /* ----- initialize some more stuff ----- */
   *emax = FLT_MIN;
   *emin = FLT_MAX;
 
-  sn = (unsigned long)(st * s->Fs / (float)d); /* which frame to start with? */  
-  if (et != ASEG_NULL_TIME) {
-    en = (unsigned long)(et * s->Fs / (float)d); /* which one's last? */
+  sn = first_frame(ctx, s->Fs, d); /* which frame to start with? */  
+  if (ctx->et != ASEG_NULL_TIME) {
+    en = (unsigned long)(ctx->et * s->Fs / (float)d); /* which one's last? */
     nframes = en - sn;
     if (! nframes)
       nframes = 1;
@@ -103,54 +169,54 @@ spfbuf_t *get_energy_profile(sigstream_t *s, unsigned short l, unsigned short d,
   else 
     en = 0;
 
-  if ((frame = sig_alloc(l)) == NULL) {
-    fprintf(stderr, "ssad error -- cannot allocate frame signal buffer\n");
-    return(NULL);
-  }
+  /* number of frames, as in get_energy_profile_chunked() */
+  n = (s->nsamples >= l) ? ((unsigned long)((s->nsamples - l) / d) + 1) : (0);
+  nalloc = (n > sn) ? (n - sn) : (0);
+  if (nframes && (nalloc == 0 || nframes < nalloc))
+    nalloc = nframes;
+  if (nalloc == 0)
+    nalloc = SSAD_PROFILE_BLOCK;
 
-  if ((buf = spf_buf_alloc(1, 40000)) == NULL) {
+  if ((buf = spf_buf_alloc(1, nalloc * sizeof(spf_t))) == NULL) {
     fprintf(stderr, "ssad error -- cannot allocate output feature buffer\n");
-    sig_free(frame);
     return(NULL);
   }
 
-  if (win) {
-    if ((sbuf = (sample_t *)malloc(l * sizeof(sample_t))) == NULL) {
-      fprintf(stderr, "ssad error -- cannot allocate memory\n");
-      sig_free(frame); spf_buf_free(buf);
-      return(NULL);
-    }
-    if ((w = set_sig_win(l, win)) == NULL) {
+  /* frames are views on the converted samples, weighted into a copy if need be */
+  if (ctx->win) {
+    if ((frame = sig_alloc(l)) == NULL || (w = set_sig_win(l, ctx->win)) == NULL) {
       fprintf(stderr, "ssad error -- cannot allocate weighting window\n");
-      free(sbuf); sig_free(frame); spf_buf_free(buf);
+      sig_free(frame); spf_buf_free(buf);
       return(NULL);    
     }
   }
-  else
-    sbuf = frame->s;
+
+  if ((fr = sig_frames_open(s, ctx->channel, l, d)) == NULL) {
+    sig_free(frame); free(w); spf_buf_free(buf);
+    return(NULL);
+  }
 
   /* ----- compute profile ----- */
   n = 0; nact = 0;
   
-  while (get_next_sig_frame(s, channel, l, d, 0.0, sbuf)) {
+  while ((v = sig_frames_next(fr)) != NULL) {
 
     if (n < sn) {
       n += 1;
       continue;
     }
 
-    /* weight signal */
+    /* compute frame energy, sig_normalize() only reading the view with flag 0 */
     if (w)
-      sig_weight(frame, sbuf, w);
-
-    /* compute frame energy */
-    e = (spf_t)sig_normalize(frame, 0);
-    if (uselog) 
+      e = (spf_t)sig_normalize(sig_weight(frame, v->s, w), 0);
+    else
+      e = (spf_t)sig_normalize((spsig_t *)v, 0);
+    if (ctx->uselog) 
       e = (e < SPRO_ENERGY_FLOOR) ? (spf_t)log(SPRO_ENERGY_FLOOR) : (spf_t)log(e);
 
-    if (spf_buf_append(buf, &e, 1, 10000) == NULL) {
+    if (spf_buf_append(buf, &e, 1, SSAD_PROFILE_BLOCK) == NULL) {
       fprintf(stderr, "ssad error -- cannot append energy value to output feature buffer\n");
-      free(sbuf); sig_free(frame); if (win) {spf_buf_free(buf); free(w);}
+      sig_frames_close(fr); spf_buf_free(buf); sig_free(frame); free(w);
       return(NULL);
     }
     
@@ -166,12 +232,206 @@ spfbuf_t *get_energy_profile(sigstream_t *s, unsigned short l, unsigned short d,
   }
 
   /* ---- clean and get out of here! ----- */
+  sig_frames_close(fr);
+  sig_free(frame);
+  free(w);
+
+  return(buf);
+}
+
+/* -------------------------------------------- */
+/* ----- static void energy_chunk(void *) ----- */
+/* -------------------------------------------- */
+/*
+ * Compute the energies of a chunk of frames of a mapped stream. The
+ * frame samples and the computations are exactly those of the serial
+ * path in get_energy_profile(), i.e. get_next_sig_frame() without
+ * pre-emphasis, so that the results are bit identical. Unweighted
+ * frames go to sig_energies(), hence to the exact sliding PCM energy
+ * kernel for 16 bits samples.
+ */
+static void energy_chunk(void *arg)
+{
+  ssad_chunk_t *c = (ssad_chunk_t *)arg;
+  sigstream_t *s = c->s;
+  float *w = NULL;
+  sample_t *sbuf;
+  spsig_t *frame;
+  char *p, *q;
+  spf_t e;
+  unsigned long i;
+  sig_conv_t conv;
+
+  c->emax = FLT_MIN;
+  c->emin = FLT_MAX;
+  c->status = 1;
+
+  if ((conv = sig_converter(s->nbps, s->nchannels, c->ctx->channel)) == NULL) {
+    fprintf(stderr, "ssad error -- unsupported sample format\n");
+    return;
+  }
+
+  if ((frame = sig_alloc(c->l)) == NULL) {
+    fprintf(stderr, "ssad error -- cannot allocate frame signal buffer\n");
+    return;
+  }
+
+  if (c->ctx->win) {
+    if ((sbuf = (sample_t *)malloc(c->l * sizeof(sample_t))) == NULL) {
+      fprintf(stderr, "ssad error -- cannot allocate memory\n");
+      sig_free(frame);
+      return;
+    }
+    if ((w = set_sig_win(c->l, c->ctx->win)) == NULL) {
+      fprintf(stderr, "ssad error -- cannot allocate weighting window\n");
+      free(sbuf); sig_free(frame);
+      return;
+    }
+  }
+  else
+    sbuf = frame->s;
+
+  p = sig_stream_map_data(s);
+
+  /* byte offsets are computed in size_t, mapped data may exceed 4 GB */
+  if (w == NULL && sig_energies(p + (size_t)c->fs * c->d * s->nchannels * s->nbps, c->fe - c->fs, c->l, c->d, s->nbps, s->nchannels, c->ctx->channel, c->e)) {
+    sig_free(frame);
+    return;
+  }
+
+  for (i = c->fs; i < c->fe; i++) {
+
+    if (w == NULL)
+      e = *(c->e + (i - c->fs));
+    else {
+      q = p + (size_t)i * c->d * s->nchannels * s->nbps;
+      conv(q, c->l, s->nchannels, c->ctx->channel, sbuf);
+
+      sig_weight(frame, sbuf, w);
+
+      e = (spf_t)sig_normalize(frame, 0);
+    }
+    if (c->ctx->uselog) 
+      e = (e < SPRO_ENERGY_FLOOR) ? (spf_t)log(SPRO_ENERGY_FLOOR) : (spf_t)log(e);
+
+    *(c->e + (i - c->fs)) = e;
+
+    if (e > c->emax)
+      c->emax = e;
+    if (e < c->emin)
+      c->emin = e;
+  }
+
   sig_free(frame); 
-  if (win) {
+  if (w) {
     free(sbuf); 
     free(w);
   }
 
+  c->status = 0;
+}
+
+/* -------------------------------------------------------------------------------- */
+/* ----- spfbuf_t *get_energy_profile_chunked(ssad_ctx_t *, sigstream_t *,    ----- */
+/* -----                                      unsigned short, unsigned short, ----- */
+/* -----                                      double *, double *)             ----- */
+/* -------------------------------------------------------------------------------- */
+/*
+ * Compute the energy profile of a mapped stream. The frames are split
+ * into consecutive chunks, each one computed by a thread directly into
+ * its slice of the output buffer. Chunks overlap by l-d samples on the
+ * signal, as consecutive frames do, so that the frames are those of
+ * the serial path.
+ */
+spfbuf_t *get_energy_profile_chunked(ssad_ctx_t *ctx, sigstream_t *s, unsigned short l, unsigned short d, double *emin, double *emax)
+{
+  spfbuf_t *buf;
+  ssad_chunk_t *chunk;
+  mthread_t *tid;
+  unsigned long nf, sn, en, n;
+  int nchunks, nthreads, k;
+  int status = 0;
+
+  *emax = FLT_MIN;
+  *emin = FLT_MAX;
+
+  if (ctx->channel < 0 || ctx->channel > s->nchannels) {
+    fprintf(stderr, "ssad error -- no channel %d in a %d channels stream\n", ctx->channel, (int)s->nchannels);
+    return(NULL);
+  }
+
+  /* frames [sn,en) as read by the serial path */
+  n = (s->nsamples >= l) ? ((unsigned long)((s->nsamples - l) / d) + 1) : (0);
+  sn = first_frame(ctx, s->Fs, d);
+  en = n;
+  if (ctx->et != ASEG_NULL_TIME) {
+    nf = (unsigned long)(ctx->et * s->Fs / (float)d) - sn;
+    if (! nf)
+      nf = 1;
+    if (sn < n && nf < n - sn)
+      en = sn + nf;
+  }
+  nf = (sn < en) ? (en - sn) : (0);
+
+  if ((buf = spf_buf_alloc(1, ((nf) ? (nf) : (1)) * sizeof(spf_t))) == NULL) {
+    fprintf(stderr, "ssad error -- cannot allocate output feature buffer\n");
+    return(NULL);
+  }
+
+  nthreads = (ctx->nthreads > 0) ? (ctx->nthreads) : (mthread_ncpu());
+  nchunks = (int)(nf / SSAD_CHUNK_MIN);
+  if (nchunks > nthreads)
+    nchunks = nthreads;
+  if (nchunks < 1)
+    nchunks = 1;
+
+  chunk = (ssad_chunk_t *)malloc(nchunks * sizeof(ssad_chunk_t));
+  tid = (mthread_t *)malloc(nchunks * sizeof(mthread_t));
+  if (chunk == NULL || tid == NULL) {
+    fprintf(stderr, "ssad error -- cannot allocate memory\n");
+    free(chunk); free(tid); spf_buf_free(buf);
+    return(NULL);
+  }
+
+  for (k = 0; k < nchunks; k++) {
+    chunk[k].ctx = ctx;
+    chunk[k].s = s;
+    chunk[k].l = l;
+    chunk[k].d = d;
+    chunk[k].fs = sn + (unsigned long)((double)nf * k / nchunks);
+    chunk[k].fe = sn + (unsigned long)((double)nf * (k + 1) / nchunks);
+    chunk[k].e = buf->s + (chunk[k].fs - sn);
+  }
+
+  /* the first chunk is ours, as are those for which no thread starts */
+  for (k = 1; k < nchunks; k++)
+    if (mthread_create(tid + k, energy_chunk, chunk + k))
+      break;
+  n = k;
+  energy_chunk(chunk);
+  for (; k < nchunks; k++)
+    energy_chunk(chunk + k);
+  for (k = 1; k < (int)n; k++)
+    mthread_join(tid[k]);
+
+  /* ----- stitch the chunks ----- */
+  for (k = 0; k < nchunks; k++) {
+    status |= chunk[k].status;
+    if (chunk[k].emax > *emax)
+      *emax = chunk[k].emax;
+    if (chunk[k].emin < *emin)
+      *emin = chunk[k].emin;
+  }
+  buf->n = nf;
+
+  free(chunk);
+  free(tid);
+
+  if (status) {
+    spf_buf_free(buf);
+    return(NULL);
+  }
+
   return(buf);
 }
 
@@ -195,50 +455,61 @@ void init_bigauss(bigauss_t *bg, double emin, double emax)
   bg->c[1] = -0.5 * bg->m[1] * bg->m[1];
 }
 
-/* ---------------------------------------------------------------------- */
-/* -----  void buf_to_bigauss(spfbuf_t *, bigauss_t *, int, double) ----- */
-/* ---------------------------------------------------------------------- */
+/* ------------------------------------------------------------------------- */
+/* ----- int buf_to_bigauss(spfbuf_t *, bigauss_t *, int, double, int) ----- */
+/* ------------------------------------------------------------------------- */
+/*
+ * Map buffer features to bi-gaussian. The assignment of the features
+ * to the gaussians is done by bigauss_stats() with at most nthreads
+ * threads. Return the number of iterations run.
+ */
+int buf_to_bigauss(spfbuf_t *e, bigauss_t *bg, int maxiter, double epsilon, int nthreads)
+{
+  return(bigauss_em(e, NULL, bg, maxiter, epsilon, nthreads));
+}
+
+/* --------------------------------------------------------------------------- */
+/* ----- int hist_to_bigauss(bigauss_hist_t *, bigauss_t *, int, double) ----- */
+/* --------------------------------------------------------------------------- */
+/*
+ * Map a histogram of the features to bi-gaussian. Whole bins are
+ * assigned to a gaussian, so that each iteration costs O(bins).
+ * Return the number of iterations run.
+ */
+int hist_to_bigauss(bigauss_hist_t *h, bigauss_t *bg, int maxiter, double epsilon)
+{
+  return(bigauss_em(NULL, h, bg, maxiter, epsilon, 1));
+}
+
+/* ----------------------------------------------------------------------------- */
+/* ----- static int bigauss_em(spfbuf_t *, bigauss_hist_t *, bigauss_t *,  ----- */
+/* -----                       int, double, int)                           ----- */
+/* ----------------------------------------------------------------------------- */
 /*
- * Map buffer features to bi-gaussian.
+ * Hard assignment EM on either the features e or their histogram h.
+ * Return the number of model updates.
  */
-void buf_to_bigauss(spfbuf_t *e, bigauss_t *bg, int maxiter, double epsilon)
+static int bigauss_em(spfbuf_t *e, bigauss_hist_t *h, bigauss_t *bg, int maxiter, double epsilon, int nthreads)
 {
-  unsigned long i, t, n1, n2;
+  unsigned long i, n1, n2;
   double m1, v1, m2, v2; /* accumulators */
   double m;
-  double llk1, llk2; /* log-likelihoods */
-  double v, vv; /* sample value */
+  double v; /* sample value */
   double llk, llkmem = 0.0; /* total data log-probability */
+  bigauss_stat_t st;
 
   i = 0;
 
   while (i < maxiter) {
-    /* set accumulators to zero */
-    n1 = n2 = 0;
-    m1 = m2 = v1 = v2 = 0.0;
-    llk = 0;
-
-    /* loop on energy profile samples */
-    for (t = 0; t < e->n; t++) {
-      v = *((e->s)+t);
-      vv = v * v;
-
-      llk1 = bg->v[0] * bg->m[0] * v - 0.5 * bg->v[0] * vv + bg->c[0];
-      llk2 = bg->v[1] * bg->m[1] * v - 0.5 * bg->v[1] * vv + bg->c[1];
-
-      if (llk1 > llk2) { /* mapped to gaussian #1 */
-	m1 += v;
-	v1 += vv;
-	n1++;
-	llk += llk1;
-      }
-      else { /* mapped to gaussian #2 */
-	m2 += v;
-	v2 += vv;
-	n2++;
-	llk += llk2;
-      }
-    }
+    /* assign energy profile samples (or bins) and accumulate */
+    if (h)
+      bigauss_hist_stats(bg, h, &st);
+    else if (bigauss_stats(bg, e, nthreads, &st))
+      break;
+    n1 = st.n[0]; n2 = st.n[1];
+    m1 = st.m[0]; m2 = st.m[1];
+    v1 = st.v[0]; v2 = st.v[1];
+    llk = st.llk;
     
    if (i&&llkmem)
 	   if ((llkmem - llk) / llkmem < epsilon)
@@ -259,83 +530,72 @@ void buf_to_bigauss(spfbuf_t *e, bigauss_t *bg, int maxiter, double epsilon)
 
     i++;
   }
+
+  return((int)i);
 }
 
 /* ---------------------------------------------------------------------------- */
-/* ------ asseg_t *profile_to_seg(spfbuf_t *, bigauss_t *, char *, float) ----- */
+/* ----- int profile_to_seg(ssad_ctx_t *, spfbuf_t *, bigauss_t *,        ----- */
+/* -----                   unsigned short, float, segtab_t *)             ----- */
 /* ---------------------------------------------------------------------------- */
 /*
- * Create segmentation from features and the two gaussians.
+ * Create segmentation from features and the two gaussians, appending
+ * the segments to tab. Segment lengths are compared to minlen as
+ * their number of frames times frate, which does not lose precision
+ * far into the signal, and the boundaries are recorded as 64 bits
+ * sample indices of frame starts, d samples apart. Return 0 if ok.
  */
-asseg_t *profile_to_seg(spfbuf_t *e, bigauss_t *bg, float frate)
+int profile_to_seg(ssad_ctx_t *ctx, spfbuf_t *e, bigauss_t *bg, unsigned short d, float Fs, segtab_t *tab)
 {
   unsigned long i;
-  float st1, et1; /* silence segment start and end times */
-  float st2, et2; /* speech segment start and end times */
+  aseg_pos_t off, et;
+  long sf1, ef1; /* silence segment start and end frames */
+  long sf2, ef2; /* speech segment start and end frames */
   unsigned long ns1, ns2;
   double d1, d2;
-  asseg_t *seg = NULL;
+  float frate = d / Fs;
   int state, label;
-  double v, vv, logp1, logp2;
-  
-  asseg_t *add_seg(asseg_t **, float, float, int);
   
+  off = (aseg_pos_t)first_frame(ctx, Fs, d) * d;
   state = UNKNOWN;
-  st1 = st2 = 0.0;
-  et1 = et2 = ASEG_NULL_TIME;
+  sf1 = sf2 = 0;
+  ef1 = ef2 = -1;
   ns1 = ns2 = 0;
   d1 = d2 = 0.0;
 
   for (i = 0; i < e->n; i++) {
 
-    v = *(e->s+i);
-
-    if (threshold != 0.0)
-      label = (v < bg->m[1] - threshold *  sqrt(1.0 / bg->v[1])) ? (SILENCE) : (SPEECH);
-    else {
-      vv = v * v;    
-      logp1 = bg->v[0] * bg->m[0] * v - 0.5 * bg->v[0] * vv + bg->c[0];
-      logp2 = bg->v[1] * bg->m[1] * v - 0.5 * bg->v[1] * vv + bg->c[1];
-
-      label = (logp1 > logp2) ? (SILENCE) : (SPEECH);
-    }
+    label = bigauss_label(ctx, bg, *(e->s+i));
 
     if (state == SPEECH && label == SILENCE) { /* potential end of a signal segment */
-      et2 = (float)i * frate; /* detected a [st2,et2] speech segment */
-      /* fprintf(stderr, " detected speech st=%.2f  et=%.2f\n", st2, et2); */
-      st1 = et2; /* start new silence segment */
+      ef2 = (long)i; /* detected a [sf2,ef2] speech segment */
+      sf1 = ef2; /* start new silence segment */
     }
     else if (state == SILENCE && label == SPEECH) { /* potential end of a silence segment */
-      et1 = (float)i * frate; /* detected a [st1,et1] silence segment */
-      /* fprintf(stderr, " detected silence st=%.2f  et=%.2f\n", st1, et1); */
+      ef1 = (long)i; /* detected a [sf1,ef1] silence segment */
 
       /* if segment is long enough, add the previous speech segment
 	 and the current silence segment. Else, simply ignore the
 	 silence segment and proceed... */
 
-      if (et1 - st1 > minlen) {
+      if ((float)(ef1 - sf1) * frate > ctx->minlen) {
 	
 	/* add previous speech segment if there was one */
-	if (ofmt & SPEECH && et2 != ASEG_NULL_TIME) {
-	  /* fprintf(stderr, " adding speech st=%.2f  et=%.2f\n", st2, et2); */
+	if (ctx->ofmt & SPEECH && ef2 >= 0) {
 	  ns2++;
-	  d2 += (et2 - st2);
-	  if (add_seg(&seg, st + st2, st + et2, SPEECH) == NULL) {
-	    seg_list_free(seg);
-	    return(NULL);
-	  }
+	  d2 += (float)(ef2 - sf2) * frate;
+	  if (add_seg(tab, off + (aseg_pos_t)sf2 * d, off + (aseg_pos_t)ef2 * d, SPEECH))
+	    return(SPRO_ALLOC_ERR);
 	}
 	
 	/* add current silence segment */
-	if (ofmt & SILENCE) {
+	if (ctx->ofmt & SILENCE) {
 	  ns1++;
-	  d1 += (et1 - st1);
-	  if (add_seg(&seg, st + st1, st + et1, SILENCE) == NULL) {
-	    seg_list_free(seg);
-	    return(NULL);
-	  }
+	  d1 += (float)(ef1 - sf1) * frate;
+	  if (add_seg(tab, off + (aseg_pos_t)sf1 * d, off + (aseg_pos_t)ef1 * d, SILENCE))
+	    return(SPRO_ALLOC_ERR);
 	}
-	st2 = et1; /* set start of new speech segment */
+	sf2 = ef1; /* set start of new speech segment */
       }
     
     }
@@ -344,102 +604,104 @@ asseg_t *profile_to_seg(spfbuf_t *e, bigauss_t *bg, float frate)
 
   /* check out if there's a last segment to output */
   if (state == SILENCE) {
-      et1 = (float)i * frate; /* detected a [st1,et1] silence segment */
+      ef1 = (long)i; /* detected a [sf1,ef1] silence segment */
       
       /* if segment is long enough, add the previous speech segment
 	 and the current silence segment. Else, add the last speech
 	 segment. */
       
-      if (et1 - st1 > minlen) {
+      if ((float)(ef1 - sf1) * frate > ctx->minlen) {
 	
 	/* add previous speech segment */
-	if (ofmt & SPEECH && et2 != ASEG_NULL_TIME) {
+	if (ctx->ofmt & SPEECH && ef2 >= 0) {
 
-	  if (add_seg(&seg, st + st2, st + et2, SPEECH) == NULL) {
-	    seg_list_free(seg);
-	    return(NULL);
-	  }
+	  if (add_seg(tab, off + (aseg_pos_t)sf2 * d, off + (aseg_pos_t)ef2 * d, SPEECH))
+	    return(SPRO_ALLOC_ERR);
 	  
 	  ns2++;
-	  d2 += (et2 - st2);
+	  d2 += (float)(ef2 - sf2) * frate;
 	}
 	
 	/* add current silence segment */
-	if (ofmt & SILENCE) {
+	if (ctx->ofmt & SILENCE) {
 
-	  if (add_seg(&seg, st + st1, st + et1, SILENCE) == NULL) {
-	    seg_list_free(seg);
-	    return(NULL);
-	  }
+	  if (add_seg(tab, off + (aseg_pos_t)sf1 * d, off + (aseg_pos_t)ef1 * d, SILENCE))
+	    return(SPRO_ALLOC_ERR);
 
 	  ns1++;
-	  d1 += (et1 - st1);
+	  d1 += (float)(ef1 - sf1) * frate;
 	}
       }
-      else if (ofmt & SPEECH) {
-	et2 = et1;
+      else if (ctx->ofmt & SPEECH) {
+	ef2 = ef1;
 
-	if (add_seg(&seg, st + st2, st + et2, SPEECH) == NULL) {
-	  seg_list_free(seg);
-	  return(NULL);
-	}
+	if (add_seg(tab, off + (aseg_pos_t)sf2 * d, off + (aseg_pos_t)ef2 * d, SPEECH))
+	  return(SPRO_ALLOC_ERR);
 	
 	ns2++;
-	d2 += (et2 - st2);
+	d2 += (float)(ef2 - sf2) * frate;
       }
   }
-  else if (ofmt & SPEECH) {
-    et2 = (float)i * frate; /* detected a [st2,et2] speech segment */
+  else if (ctx->ofmt & SPEECH) {
+    ef2 = (long)i; /* detected a [sf2,ef2] speech segment */
 
-    if (add_seg(&seg, st + st2, st + et2, SPEECH) == NULL) {
-      seg_list_free(seg);
-      return(NULL);
-    }    
+    if (add_seg(tab, off + (aseg_pos_t)sf2 * d, off + (aseg_pos_t)ef2 * d, SPEECH))
+      return(SPRO_ALLOC_ERR);
 
     ns2++;
-    d2 += (et2 - st2);
+    d2 += (float)(ef2 - sf2) * frate;
   }
   
   /* adjust end time to exact specified time if et is given */
-  if (et != ASEG_NULL_TIME) {
-    asseg_t *p = seg;
-    while (p->next)
-      p = p->next;
-    if (fabs(et - get_seg_end_time(p)) < frate)
-      set_seg_end_time(p, et);
+  if (ctx->et != ASEG_NULL_TIME && tab->n) {
+    et = (aseg_pos_t)(ctx->et * (double)Fs + 0.5);
+    if ((et > tab->seg[tab->n-1].et) ? (et - tab->seg[tab->n-1].et < d) : (tab->seg[tab->n-1].et - et < d))
+      tab->seg[tab->n-1].et = et;
   }
-  return(seg);
+
+  return(0);
 }
 
-/* ----------------------------------------------------------- */
-/* ----- asseg_t *add_seg(asseg_t **, float, float, int) ----- */
-/* ----------------------------------------------------------- */
+/* ---------------------------------------------------------------- */
+/* ----- int bigauss_label(ssad_ctx_t *, bigauss_t *, double) ----- */
+/* ---------------------------------------------------------------- */
 /*
- * Add a segment after the current segment, returning the adress of
- * the new segment.
+ * Classify a single frame energy as SILENCE or SPEECH, either by
+ * maximum likelihood or, if a threshold is set, by its deviation
+ * below the speech Gaussian.
  */
-asseg_t *add_seg(asseg_t **seg, float st, float et, int label)
+int bigauss_label(ssad_ctx_t *ctx, bigauss_t *bg, double v)
 {
-  static asseg_t *last = NULL;
-  asseg_t *p;
-  char silstr[] = SILENCE_STRING;
-  char sigstr[] = SPEECH_STRING;
+  double vv, logp1, logp2;
 
-  if (label == SILENCE)
-    p = seg_create(silstr, st, et, 0.0);
-  else
-    p = seg_create(sigstr, st, et, 0.0);
+  if (ctx->threshold != 0.0)
+    return((v < bg->m[1] - ctx->threshold *  sqrt(1.0 / bg->v[1])) ? (SILENCE) : (SPEECH));
 
-  if (*seg == NULL)
-    *seg = p;
-  
-  if (last)
-    last->next = p;
+  vv = v * v;    
+  logp1 = bg->v[0] * bg->m[0] * v - 0.5 * bg->v[0] * vv + bg->c[0];
+  logp2 = bg->v[1] * bg->m[1] * v - 0.5 * bg->v[1] * vv + bg->c[1];
 
-  p->prev = last;
-  last = p;
-  
-  return(p);
+  return((logp1 > logp2) ? (SILENCE) : (SPEECH));
+}
+
+/* ---------------------------------------------------------------- */
+/* ----- int add_seg(segtab_t *, aseg_pos_t, aseg_pos_t, int) ----- */
+/* ---------------------------------------------------------------- */
+/*
+ * Append a [st,et[ segment (in samples) to the segmentation. Return
+ * 0 if ok.
+ */
+int add_seg(segtab_t *tab, aseg_pos_t st, aseg_pos_t et, int label)
+{
+  int id;
+
+  if ((id = seg_tab_label(tab, (label == SILENCE) ? (SILENCE_STRING) : (SPEECH_STRING))) < 0)
+    return(SPRO_ALLOC_ERR);
+
+  if (seg_tab_append(tab, st, et, (unsigned short)id, 0.0) == NULL)
+    return(SPRO_ALLOC_ERR);
+
+  return(0);
 }
 
 #undef _ssad_c_
\ No newline at end of file
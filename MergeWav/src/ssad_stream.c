@@ -0,0 +1,414 @@
+/******************************************************************************/
+/*                                                                            */
+/*                               ssad_stream.c                                */
+/*                                                                            */
+/*****************************************************************************
+ * Single pass signal activity detection and merge.
+ *
+ * silence_detection() needs the whole energy profile before it can
+ * output a single segment, after which MergeWav() has to read the
+ * input file a second time to copy the speech segments. The stream
+ * detector below reads every input sample exactly once: raw sample
+ * frames, all channels included, are kept in a bounded ring behind the
+ * frame cursor and are either written to the output or dropped as soon
+ * as the frame labels allow a decision.
+ *
+ * The bi-gaussian model is estimated on the first warmup seconds of
+ * the stream, which are therefore held in the ring until the model is
+ * known. For streams shorter than the warmup length, the model and
+ * the decisions are exactly those of silence_detection(). Afterwards,
+ * the ring only holds the pending silence, i.e. at most minlen seconds
+ * plus one frame.
+ *
+ * Speech is kept and silence dropped exactly as in profile_to_seg():
+ * a silence shorter than minlen is part of the surrounding speech
+ * segment, and a silence is known to be long as soon as it lasts more
+ * than minlen, without waiting for its end.
+ *
+ * For live input, the model can follow the signal instead of being
+ * frozen after the warmup (ctx->halflife > 0): each new frame is
+ * assigned to the closest gaussian, whose statistics are exponentially
+ * decayed sums of the frames it was given, the weight of a frame
+ * halving every halflife seconds. Frames are labelled ctx->lookahead
+ * seconds after they are read, i.e. with a model that has already
+ * seen the next frames. Memory is bounded by the ring whatever the
+ * stream length, and the output lags the input by at most lookahead
+ * plus minlen seconds.
+ */
+
+#define _ssad_stream_c_
+
+#include "ssad.h"
+
+#define SSAD_STREAM_CHUNK 8192    /* ring refill size (num. sample frames)    */
+#define SSAD_ONLINE_MIN 10.0      /* min. decayed frames to update a gaussian */
+
+typedef struct {
+  ssad_ctx_t *ctx;                /* detector settings                        */
+  char *r;                        /* raw sample frames                        */
+  unsigned short bpf;             /* bytes per sample frame                   */
+  unsigned long m;                /* ring capacity (num. sample frames)       */
+  unsigned long n;                /* number of sample frames in ring          */
+  aseg_pos_t r0;                  /* stream index of r[0]                     */
+  aseg_pos_t wpos;                /* first sample not yet written or dropped  */
+  wavout_t *out;                  /* output, with the gaps between segments   */
+  int state;                      /* label of the last frame                  */
+  int segopen;                    /* speech seen since the last long silence  */
+  int dropping;                   /* inside a silence longer than minlen      */
+  unsigned long sf1;              /* current silence start frame              */
+  float frate;                    /* frame period in s                        */
+  unsigned short d;               /* frame shift (num. samples)               */
+} ring_t;
+
+/* exponentially decayed assignment statistics of the online model */
+typedef struct {
+  double lambda;                  /* per frame decay                          */
+  double n[2];                    /* decayed number of features per gaussian  */
+  double s1[2];                   /* decayed sum of the features              */
+  double s2[2];                   /* decayed sum of the squared features      */
+} online_t;
+
+/* ----------------------------------------------------------- */
+/* ----- static int ring_emit(ring_t *, aseg_pos_t, int) ----- */
+/* ----------------------------------------------------------- */
+/*
+ * Write (or drop) all ring samples up to stream index b. Return 0 if ok.
+ */
+static int ring_emit(ring_t *p, aseg_pos_t b, int keep)
+{
+  unsigned long n;
+  int status;
+
+  if (b <= p->wpos)
+    return(0);
+
+  n = (unsigned long)(b - p->wpos);
+
+  if (keep && (status = wavout_write(p->out, p->r + (size_t)(p->wpos - p->r0) * p->bpf, n)) != 0)
+    return(status);
+
+  p->wpos = b;
+
+  return(0);
+}
+
+/* ---------------------------------------------------------------- */
+/* ----- static int ring_decide(ring_t *, unsigned long, int) ----- */
+/* ---------------------------------------------------------------- */
+/*
+ * Feed the label of frame i to the segmentation state machine and write
+ * out whatever is decided by it.
+ */
+static int ring_decide(ring_t *p, unsigned long i, int label)
+{
+  aseg_pos_t b = (aseg_pos_t)(i + 1) * p->d; /* end of the samples decided by frame i */
+  int status = 0;
+
+  if (label == SPEECH) {
+    /* a pending silence is either already dropped or short enough */
+    p->dropping = 0;
+    p->segopen = 1;
+    status = ring_emit(p, b, 1);
+  }
+  else {
+    if (p->state != SILENCE) { /* start of a new silence */
+      if ((status = ring_emit(p, (aseg_pos_t)i * p->d, 1)) != 0)
+	return(status);
+      p->sf1 = i;
+    }
+
+    if (! p->dropping && (float)(i + 1 - p->sf1) * p->frate > p->ctx->minlen) {
+      p->dropping = 1;
+      if (p->segopen) {
+	p->segopen = 0;
+	status = wavout_gap(p->out);
+      }
+    }
+
+    if (p->dropping && status == 0)
+      status = ring_emit(p, b, 0);
+  }
+
+  p->state = label;
+
+  return(status);
+}
+
+/* --------------------------------------------------------------------------- */
+/* ----- static long ring_fill(ring_t *, sigstream_t *, unsigned long *, ----- */
+/* -----                      aseg_pos_t)                                ----- */
+/* --------------------------------------------------------------------------- */
+/*
+ * Drop from the ring the sample frames before keep and append at most
+ * one chunk of new sample frames from the stream. Return the number of
+ * frames appended, 0 at the end of the stream or -1 if the ring is
+ * full.
+ */
+static long ring_fill(ring_t *p, sigstream_t *s, unsigned long *bp, aseg_pos_t keep)
+{
+  unsigned long k;
+
+  if (keep > p->r0) {
+    k = (unsigned long)(keep - p->r0);
+    memmove(p->r, p->r + (size_t)k * p->bpf, (size_t)(p->n - k) * p->bpf);
+    p->n -= k;
+    p->r0 = keep;
+  }
+
+  if (p->n == p->m) {
+    fprintf(stderr, "ssad_stream_merge(): sample ring overflow\n");
+    return(-1);
+  }
+
+  if (*bp >= s->buf->n) {
+    if (sig_stream_read(s) == 0)
+      return(0);
+    *bp = 0;
+  }
+
+  k = (s->buf->n - *bp) / s->nchannels;
+  if (k > p->m - p->n)
+    k = p->m - p->n;
+  if (k > SSAD_STREAM_CHUNK)
+    k = SSAD_STREAM_CHUNK;
+
+  memcpy(p->r + (size_t)p->n * p->bpf, (char *)s->buf->s + (size_t)*bp * s->nbps, (size_t)k * p->bpf);
+
+  p->n += k;
+  *bp += k * s->nchannels;
+
+  return((long)k);
+}
+
+/* -------------------------------------------------------------------------------- */
+/* ----- static void online_init(online_t *, bigauss_t *, spfbuf_t *, double) ----- */
+/* -------------------------------------------------------------------------------- */
+/*
+ * Seed the decayed statistics with the assignment of the warmup frames.
+ */
+static void online_init(online_t *o, bigauss_t *bg, spfbuf_t *e, double lambda)
+{
+  bigauss_stat_t st;
+  int k;
+
+  o->lambda = lambda;
+
+  if (bigauss_stats(bg, e, 1, &st)) {
+    st.n[0] = st.n[1] = 0;
+    st.m[0] = st.m[1] = st.v[0] = st.v[1] = 0.0;
+  }
+
+  for (k = 0; k < 2; k++) {
+    o->n[k] = (double)st.n[k];
+    o->s1[k] = st.m[k];
+    o->s2[k] = st.v[k];
+  }
+}
+
+/* ---------------------------------------------------------------------- */
+/* ----- static void online_update(online_t *, bigauss_t *, double) ----- */
+/* ---------------------------------------------------------------------- */
+/*
+ * Decay the statistics, add feature v to the most likely gaussian and
+ * re-estimate the latter. The other gaussian is left as is, since its
+ * statistics are merely scaled.
+ */
+static void online_update(online_t *o, bigauss_t *bg, double v)
+{
+  double logp1, logp2, m, iv;
+  int j, k;
+
+  logp1 = bg->v[0] * bg->m[0] * v - 0.5 * bg->v[0] * v * v + bg->c[0];
+  logp2 = bg->v[1] * bg->m[1] * v - 0.5 * bg->v[1] * v * v + bg->c[1];
+  k = (logp1 > logp2) ? 0 : 1;
+
+  for (j = 0; j < 2; j++) {
+    o->n[j] *= o->lambda;
+    o->s1[j] *= o->lambda;
+    o->s2[j] *= o->lambda;
+  }
+  o->n[k] += 1.0;
+  o->s1[k] += v;
+  o->s2[k] += v * v;
+
+  if (o->n[k] < SSAD_ONLINE_MIN)
+    return;
+
+  m = o->s1[k] / o->n[k];
+  if ((iv = o->s2[k] - m * o->s1[k]) <= 0.0)
+    return;
+  iv = o->n[k] / iv; /* inverse of the variance estimator */
+
+  bg->m[k] = m;
+  bg->v[k] = iv;
+  bg->c[k] = 0.5 * (log(iv) - m * m * iv);
+}
+
+/* -------------------------------------------------------------------------- */
+/* ----- int ssad_stream_merge(ssad_ctx_t *, sigstream_t *, wavout_t *) ----- */
+/* -------------------------------------------------------------------------- */
+/*
+ * Detect speech on channel ctx->channel of a PCM input stream (on the
+ * mean of the channels if 0) and write the speech sample frames, all
+ * channels included, to out as they are decided, each segment being
+ * closed by wavout_gap(). The bi-gaussian model is trained on the
+ * first ctx->warmup seconds of the stream, then adapted to each new
+ * frame if ctx->halflife is set. Return 0 if ok.
+ */
+int ssad_stream_merge(ssad_ctx_t *ctx, sigstream_t *s, wavout_t *out)
+{
+  ring_t ring;
+  bigauss_t bg;
+  online_t ol;
+  spfbuf_t *e;
+  spf_t v, *eb, *q;
+  unsigned short l, d;
+  unsigned long nw, la, i, t, bp, k, nf, f;
+  aseg_pos_t fpos;
+  long nfill;
+  double emin, emax;
+  int niter, status = 0;
+
+  if (s->nbps < 1 || s->nbps > 4 || ctx->channel < 0 || ctx->channel > s->nchannels) {
+    fprintf(stderr, "ssad_stream_merge(): unsupported input stream\n");
+    return(SPRO_BAD_PARAM_ERR);
+  }
+
+  l = (unsigned short)(ctx->fm_l * s->Fs / 1000.0);
+  d = (unsigned short)(ctx->fm_d * s->Fs / 1000.0);
+  nw = (unsigned long)(ctx->warmup * s->Fs / (float)d);
+  if (nw == 0)
+    nw = 1;
+  la = (unsigned long)(ctx->lookahead * s->Fs / (float)d);
+
+  ring.m = nw * d + l;
+  k = (unsigned long)(ctx->minlen * s->Fs) + 2 * l + la * d;
+  if (ring.m < k)
+    ring.m = k;
+  ring.m += SSAD_STREAM_CHUNK;
+
+  ring.bpf = (unsigned short)(s->nbps * s->nchannels);
+  if ((ring.r = (char *)malloc((size_t)ring.m * ring.bpf)) == NULL) {
+    fprintf(stderr, "ssad_stream_merge(): cannot allocate sample ring\n");
+    return(SPRO_ALLOC_ERR);
+  }
+
+  if ((e = spf_buf_alloc(1, nw * sizeof(spf_t))) == NULL) {
+    fprintf(stderr, "ssad_stream_merge(): cannot allocate warmup feature buffer\n");
+    free(ring.r);
+    return(SPRO_ALLOC_ERR);
+  }
+
+  /* energies of the frames completed by one ring refill, then of the undecided ones */
+  if ((eb = (spf_t *)malloc((SSAD_STREAM_CHUNK / d + 2 + la + 1) * sizeof(spf_t))) == NULL) {
+    fprintf(stderr, "ssad_stream_merge(): cannot allocate energy buffer\n");
+    spf_buf_free(e); free(ring.r);
+    return(SPRO_ALLOC_ERR);
+  }
+  q = eb + SSAD_STREAM_CHUNK / d + 2;
+
+  ring.ctx = ctx;
+  ring.n = ring.r0 = ring.wpos = 0;
+  ring.out = out;
+  ring.state = UNKNOWN;
+  ring.segopen = ring.dropping = 0;
+  ring.sf1 = 0;
+  ring.frate = d / s->Fs;
+  ring.d = d;
+
+  emax = FLT_MIN;
+  emin = FLT_MAX;
+  ol.lambda = 1.0; /* set by online_init() after the warmup */
+  fpos = 0; i = 0; bp = s->buf->n;
+
+  /* ----- frame loop ----- */
+  while (status == 0) {
+
+    /* keep everything until the model is known, then only what is undecided */
+    nfill = ring_fill(&ring, s, &bp, (e) ? (0) : ((ring.wpos < fpos) ? (ring.wpos) : (fpos)));
+    if (nfill <= 0) {
+      if (nfill < 0)
+	status = SPRO_BUF_SIZE_ERR;
+      break;
+    }
+
+    /* compute frame energies -- same as sig_normalize() on each frame */
+    nf = (fpos + l <= ring.r0 + ring.n) ? ((unsigned long)(ring.r0 + ring.n - fpos - l) / d + 1) : (0);
+    if (sig_energies(ring.r + (size_t)(fpos - ring.r0) * ring.bpf, nf, l, d, s->nbps, s->nchannels, ctx->channel, eb)) {
+      status = SPRO_ALLOC_ERR;
+      break;
+    }
+
+    for (f = 0; status == 0 && f < nf; f++) {
+
+      v = *(eb+f);
+      if (ctx->uselog)
+	v = (v < SPRO_ENERGY_FLOOR) ? (spf_t)log(SPRO_ENERGY_FLOOR) : (spf_t)log(v);
+
+      if (e) { /* still in the warmup period */
+	spf_buf_append(e, &v, 1, 0);
+	if (v > emax)
+	  emax = v;
+	if (v < emin)
+	  emin = v;
+
+	if (e->n == nw) {
+	  init_bigauss(&bg, emin, emax);
+	  niter = buf_to_bigauss(e, &bg, 20, 0.0001, 1);
+	  MWSTATS_ADD(ctx->stats, niter, niter);
+	  if (ctx->halflife > 0.0)
+	    online_init(&ol, &bg, e, pow(0.5, ring.frate / ctx->halflife));
+	  for (t = 0; t < e->n && status == 0; t++)
+	    status = ring_decide(&ring, t, bigauss_label(ctx, &bg, *(e->s+t)));
+	  spf_buf_free(e);
+	  e = NULL;
+	}
+      }
+      else {
+	if (ctx->halflife > 0.0)
+	  online_update(&ol, &bg, v);
+	/* frame i - la has now been looked ahead of */
+	*(q + i % (la + 1)) = v;
+	if (i >= nw + la)
+	  status = ring_decide(&ring, i - la, bigauss_label(ctx, &bg, *(q + (i - la) % (la + 1))));
+      }
+
+      fpos += d;
+      i++;
+    }
+
+    if (ctx->halflife > 0.0)
+      fflush(out->f);
+  }
+
+  /* ----- frames still within the lookahead at the end of the stream ----- */
+  for (t = (i > nw + la) ? (i - la) : (nw); ! e && t < i && status == 0; t++)
+    status = ring_decide(&ring, t, bigauss_label(ctx, &bg, *(q + t % (la + 1))));
+
+  /* ----- stream shorter than the warmup period ----- */
+  if (e && status == 0) {
+    if (e->n) {
+      init_bigauss(&bg, emin, emax);
+      niter = buf_to_bigauss(e, &bg, 20, 0.0001, 1);
+      MWSTATS_ADD(ctx->stats, niter, niter);
+    }
+    for (t = 0; t < e->n && status == 0; t++)
+      status = ring_decide(&ring, t, bigauss_label(ctx, &bg, *(e->s+t)));
+  }
+  spf_buf_free(e);
+
+  /* ----- close the last segment unless we're in a long silence ----- */
+  if (status == 0 && ! ring.dropping)
+    if ((status = ring_emit(&ring, (aseg_pos_t)i * d, 1)) == 0)
+      status = wavout_gap(ring.out);
+
+  free(ring.r);
+  free(eb);
+
+  MWSTATS_ADD(ctx->stats, nbytes_read, s->nread * s->nchannels * s->nbps);
+  MWSTATS_ADD(ctx->stats, nfread, s->nfread);
+
+  return(status);
+}
+
+#undef _ssad_stream_c_
@@ -1,115 +1,115 @@
 #include "wavheader.h"
+#include "spro.h"
 
+/* format and data chunk of a wave file, walking its chunks as the signal streams do */
 head_pama wav_header_read(const char* wavfile)
 {
-    char ChunkID[4],Format[4],Subchunk1ID[4],Subchunk2ID[4];
-    int  ChunkSize,Subchunk1Size,SampleRate,Subchunk2Size;
-    short AudioFormat,NumChannels,BitsPerSample;
-    head_pama pt;
+    sigwavehdr_t hdr;
+    head_pama pt={0,0,0,0,0,0};
+    int status;
 
+	/* on error, a null header is returned and the caller rejects the file */
 	FILE* fp;
-	fp=fopen(wavfile,"rb+");
+	fp=fopen(wavfile,"rb");
 	if(fp == NULL)
 	{
 		printf("Can't open wave file!\n");
+		return pt;
 	}
 
-    fseek(fp, 0, SEEK_SET);
-    fread(ChunkID, 1, 4, fp);
-    if(strncmp("RIFF", ChunkID, 4) != 0)
-    {
-        printf("The input file is not wav format!\n");
-        exit(2);
-    }
-
-    fread(&ChunkSize, 4, 1, fp);
-
-    fread(Format, 1, 4, fp);
-    if(strncmp("WAVE", Format, 4) != 0)
-    {
-        printf("The input file is not wav format!\n");
-        exit(2);
-    }
-
-    fread(Subchunk1ID, 1, 4, fp);
-    if(strncmp("fmt ", Subchunk1ID, 4) != 0)
+    status = sig_wave_header(fp, &hdr);
+    fclose(fp);
+    if(status || hdr.format != SPRO_WAVE_FORMAT_PCM)
     {
         printf("The input file is not wav format!\n");
-        exit(2);
-    }
-    
-    fread(&Subchunk1Size, 4, 1, fp);
-	
-    fread(&AudioFormat, 2, 1, fp);
-
-    fread(&NumChannels, 2, 1, fp);
- 
-    fread(&SampleRate , 4, 1, fp);
-
-    fseek(fp,34,SEEK_SET);
-    fread(&BitsPerSample, 2, 1, fp);
-
-    fread(Subchunk2ID, 1, 4, fp);
-    if(strncmp("data", Subchunk2ID, 4) != 0)
-    {
-        printf("This file is not wave!\n");
-        exit(2);
+        return pt;
     }
 
-	fseek(fp,40,SEEK_SET);
-	fread(&Subchunk2Size, 4, 1, fp);
-
-    pt.bits=BitsPerSample;
-    pt.channels=NumChannels;
-    pt.rate=SampleRate;
-	pt.datasize=Subchunk2Size;
-    fclose(fp);
+    /* the container size, which is what the sample layout depends on */
+    pt.bits=(hdr.nchannels) ? (short)(hdr.blockalign/hdr.nchannels*8) : 0;
+    pt.channels=hdr.nchannels;
+    pt.rate=hdr.Fs;
+	pt.datasize=(hdr.blockalign) ? (long long)(hdr.datasize/hdr.blockalign) : 0;
+	pt.dataoff=hdr.dataoff;
     return pt;
 }
 
-void wav_write_header(FILE* fp,head_pama pt)
+/* PCM samples of 1 to 4 bytes, any rate and number of channels */
+int wav_format_supported(head_pama pt)
 {
-    int long_temp;
-    short short_temp;
-    short BlockAlign;
-    char *data = NULL;
-
-    data = "RIFF";
-    fwrite(data, sizeof(char), 4, fp);
-
-    long_temp=pt.datasize*2+36;
-	fwrite(&long_temp, sizeof(long_temp), 1, fp);
-
-    data = "WAVE";
-    fwrite(data, sizeof(char), 4, fp);
+    return pt.rate > 0 && pt.channels > 0 && pt.bits > 0 && pt.bits % 8 == 0 && pt.bits <= 32;
+}
 
-    data = "fmt ";
-    fwrite(data, sizeof(char), 4, fp);
+/* little endian field of n bytes */
+static void wav_write_field(FILE* fp, unsigned long long v, int n)
+{
+    unsigned char b[8];
+    int i;
 
-    long_temp = 16;
-    fwrite(&long_temp, sizeof(long_temp), 1, fp);
+    for(i = 0; i < n; i++, v >>= 8)
+        b[i] = (unsigned char)(v & 0xFF);
+    fwrite(b, 1, n, fp);
+}
 
-    short_temp = 0x0001;
-    fwrite(&short_temp, sizeof(short_temp), 1, fp);
+/* data chunk size in bytes, and whether the header is a RF64 one */
+static int wav_header_rf64(head_pama pt, unsigned long long* DataBytes)
+{
+    unsigned long long BlockAlign = ((pt.bits)/8) * (pt.channels);
 
-    short_temp = pt.channels;
-    fwrite(&short_temp, sizeof(short_temp), 1, fp);
+    *DataBytes = (pt.datasize > 0) ? (unsigned long long)pt.datasize * BlockAlign : 0;
 
-    long_temp = pt.rate;
-    fwrite(&long_temp, sizeof(long_temp), 1, fp);
-    
-    long_temp = ((pt.bits)/8) * (pt.channels) * (pt.rate);
-    fwrite(&long_temp, sizeof(long_temp), 1, fp);
+    switch(pt.layout)
+    {
+    case WAV_LAYOUT_RIFF:
+        /* sizes are kept below the 4 GB RIFF limit, in whole sample frames */
+        if(BlockAlign > 0 && *DataBytes > WAV_RIFF_MAXDATA)
+            *DataBytes = WAV_RIFF_MAXDATA / BlockAlign * BlockAlign;
+        return 0;
+    case WAV_LAYOUT_RESERVE:
+        /* the JUNK chunk counts in the RIFF size */
+        return *DataBytes > WAV_RIFF_MAXDATA - 36;
+    default:
+        return *DataBytes > WAV_RIFF_MAXDATA;
+    }
+}
 
-    BlockAlign = ((pt.bits)/8) * (pt.channels);
-    fwrite(&BlockAlign, sizeof(BlockAlign), 1, fp);
+/*
+ * pt.datasize is the number of sample frames, i.e. of samples per channel.
+ * Over 4 GB of data, a RF64 header is written (EBU Tech 3306): the 32 bits
+ * sizes are then -1 and the actual ones are in the ds64 chunk.
+ * Return the header length in bytes.
+ */
+int wav_write_header(FILE* fp,head_pama pt)
+{
+    unsigned long long DataBytes;
+    int rf64 = wav_header_rf64(pt, &DataBytes);
+    int ds64 = rf64 || pt.layout == WAV_LAYOUT_RESERVE;
 
-    short_temp = pt.bits;
-    fwrite(&short_temp, sizeof(short_temp), 1, fp);
+    fwrite((rf64) ? "RF64" : "RIFF", sizeof(char), 4, fp);
+    wav_write_field(fp, (rf64) ? 0xFFFFFFFFULL : DataBytes+((ds64) ? 72 : 36), 4);
+    fwrite("WAVE", sizeof(char), 4, fp);
 
-    data = "data";
-    fwrite(data, sizeof(char), 4, fp);
+    /* ds64 chunk, or the JUNK chunk keeping its room */
+    if(ds64)
+    {
+        fwrite((rf64) ? "ds64" : "JUNK", sizeof(char), 4, fp);
+        wav_write_field(fp, 28, 4);
+        wav_write_field(fp, (rf64) ? DataBytes+72 : 0, 8);
+        wav_write_field(fp, (rf64) ? DataBytes : 0, 8);
+        wav_write_field(fp, (rf64) ? (unsigned long long)pt.datasize : 0, 8);
+        wav_write_field(fp, 0, 4);
+    }
 
-    long_temp = pt.datasize*(pt.channels)*(pt.bits/8);
-    fwrite(&long_temp, sizeof(long_temp), 1, fp);
-}
\ No newline at end of file
+    fwrite("fmt ", sizeof(char), 4, fp);
+    wav_write_field(fp, 16, 4);
+    wav_write_field(fp, 0x0001, 2);
+    wav_write_field(fp, pt.channels, 2);
+    wav_write_field(fp, pt.rate, 4);
+    wav_write_field(fp, ((pt.bits)/8) * (pt.channels) * (pt.rate), 4);
+    wav_write_field(fp, ((pt.bits)/8) * (pt.channels), 2);
+    wav_write_field(fp, pt.bits, 2);
+
+    fwrite("data", sizeof(char), 4, fp);
+    wav_write_field(fp, (rf64) ? 0xFFFFFFFFULL : DataBytes, 4);
+    return (ds64) ? 80 : 44;
+}
@@ -0,0 +1,375 @@
+/******************************************************************************/
+/*                                                                            */
+/*                                  wavout.c                                  */
+/*                                                                            */
+/*****************************************************************************
+ * Output of the merged segments.
+ *
+ * Both the batch and the stream writers hand their speech sample
+ * frames to a wavout_t and call wavout_gap() at the end of each
+ * segment. The gap between two segments is either
+ *
+ *  - silence, extended as a file hole when possible (see fzero()),
+ *    or written from a block of null frames for 8 bits samples,
+ *  - comfort noise, i.e. white noise at WAVOUT_NOISE_DB, written
+ *    from a block generated once,
+ *  - a crossfade, the last frames of a segment being overlapped with
+ *    the first ones of the next segment: the gap length is then that
+ *    of the overlap, and the output gets shorter.
+ *
+ * To crossfade, the last ngap frames written are held back, as the
+ * end of a segment is only known once wavout_gap() is called. A
+ * segment shorter than the overlap fades what is left of the previous
+ * one out into silence.
+ *
+ * Frames are counted as they are written, so that the output header
+ * is always set from the number of frames actually written. Calls and
+ * bytes are also counted into stats, when set by the caller.
+ */
+
+#include "wavout.h"
+#include "fsplice.h"
+#include "spro.h"
+#include <STDLIB.H>
+#include <STRING.H>
+#include <MATH.H>
+
+#define WAVOUT_COPY_BLOCK 65536   /* buffered copy size (in bytes)            */
+
+/* -------------------------------------------------------------- */
+/* ----- void putsample(char *, unsigned long, int, double) ----- */
+/* -------------------------------------------------------------- */
+/*
+ * Set the n'th sample of a buffer of m bytes samples to the rounded
+ * and clipped value v, as getsample() reads them back.
+ */
+void putsample(char *p, unsigned long n, int m, double v)
+{
+  double max = ldexp(1.0, 8 * m - 1);
+  long long x;
+  unsigned char *b;
+
+  v = floor(v + 0.5);
+  x = (long long)((v < -max) ? (-max) : (v > max - 1.0) ? (max - 1.0) : (v));
+
+  switch(m) {
+  case 1:
+    *((unsigned char *)p+n) = (unsigned char)(x + 128);
+    break;
+  case 2:
+    *((short *)p+n) = (short)x;
+    break;
+  case 3:
+    b = (unsigned char *)p + 3 * n;
+    b[0] = (unsigned char)(x & 0xFF);
+    b[1] = (unsigned char)((x >> 8) & 0xFF);
+    b[2] = (unsigned char)((x >> 16) & 0xFF);
+    break;
+  case 4:
+    *((int *)p+n) = (int)x;
+    break;
+  }
+}
+
+/* ----------------------------------------------------------------- */
+/* ----- wavout_t *wavout_alloc(FILE *, head_pama, int, float) ----- */
+/* ----------------------------------------------------------------- */
+/*
+ * Allocate the output of fmt sample frames to f, segments being
+ * separated by gaps of gap ms of the given mode. Return NULL in case
+ * of error.
+ */
+wavout_t *wavout_alloc(FILE *f, head_pama fmt, int mode, float gap)
+{
+  wavout_t *p;
+  unsigned long i, x = 1;
+  double a, u;
+  int k;
+
+  if ((p = (wavout_t *)malloc(sizeof(wavout_t))) == NULL) {
+    fprintf(stderr, "wavout_alloc() -- cannot allocate %lu bytes\n", (unsigned long)sizeof(wavout_t));
+    return(NULL);
+  }
+
+  p->f = f;
+  p->mode = mode;
+  p->ngap = (gap > 0.0) ? (unsigned long)((double)gap * fmt.rate / 1000.0 + 0.5) : (0);
+  p->nbps = fmt.bits / 8;
+  p->nch = (unsigned short)fmt.channels;
+  p->bpf = (unsigned short)(p->nbps * p->nch);
+  p->blk = p->tail = NULL;
+  p->nblk = p->ntail = p->nfade = p->fpos = 0;
+  p->nwritten = 0;
+  p->stats = NULL;
+
+  /* null 16 bits and up samples are written by fzero() */
+  if (p->ngap == 0 || (mode == WAVOUT_SILENCE && p->nbps > 1))
+    return(p);
+
+  p->nblk = (p->ngap < WAVOUT_BLOCK) ? (p->ngap) : (WAVOUT_BLOCK);
+  if ((p->blk = (char *)malloc((size_t)p->nblk * p->bpf)) == NULL ||
+      (mode == WAVOUT_CROSSFADE && (p->tail = (char *)malloc((size_t)p->ngap * p->bpf)) == NULL)) {
+    fprintf(stderr, "wavout_alloc() -- cannot allocate gap buffers\n");
+    wavout_free(p);
+    return(NULL);
+  }
+
+  switch(mode) {
+  case WAVOUT_SILENCE:
+    memset(p->blk, 0x80, (size_t)p->nblk * p->bpf);
+    break;
+  case WAVOUT_NOISE:
+    /* sum of 4 uniform draws, scaled to the RMS level (fixed seed, so that outputs are reproducible) */
+    a = ldexp(pow(10.0, WAVOUT_NOISE_DB / 20.0), 8 * p->nbps - 1) * sqrt(3.0);
+    for (i = 0; i < p->nblk * p->nch; i++) {
+      for (k = 0, u = -2.0; k < 4; k++) {
+	x = (x * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+	u += (double)(x >> 8) / 16777216.0;
+      }
+      putsample(p->blk, i, p->nbps, a * u);
+    }
+    break;
+  }
+
+  return(p);
+}
+
+/* ---------------------------------------- */
+/* ----- void wavout_free(wavout_t *) ----- */
+/* ---------------------------------------- */
+void wavout_free(wavout_t *p)
+{
+  if (p) {
+    free(p->blk);
+    free(p->tail);
+    free(p);
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+/* ----- static int wavout_put(wavout_t *, const char *, unsigned long) ----- */
+/* -------------------------------------------------------------------------- */
+/*
+ * Write n frames out. Return 0 if ok.
+ */
+static int wavout_put(wavout_t *p, const char *b, unsigned long n)
+{
+  if (n == 0)
+    return(0);
+
+  MWSTATS_ADD(p->stats, nfwrite, 1);
+  if (fwrite(b, p->bpf, n, p->f) != n) {
+    fprintf(stderr, "wavout_write() -- cannot write output samples\n");
+    return(SPRO_SIG_WRITE_ERR);
+  }
+  p->nwritten += n;
+  MWSTATS_ADD(p->stats, nbytes_written, (unsigned long long)n * p->bpf);
+
+  return(0);
+}
+
+/* --------------------------------------------------------------------------- */
+/* ----- static int wavout_fade(wavout_t *, const char *, unsigned long) ----- */
+/* --------------------------------------------------------------------------- */
+/*
+ * Mix the n next tail frames being faded out with the n frames b being
+ * faded in (silence if b is NULL) and write them out. Return 0 if ok.
+ */
+static int wavout_fade(wavout_t *p, const char *b, unsigned long n)
+{
+  unsigned long i, j, k, nch = p->nch;
+  double w;
+  int status;
+
+  while (n) {
+    k = (n < p->nblk) ? (n) : (p->nblk);
+    for (i = 0; i < k; i++) {
+      w = (double)(p->fpos + i + 1) / (double)(p->nfade + 1);
+      for (j = 0; j < nch; j++)
+	putsample(p->blk, i * nch + j, p->nbps,
+		  (1.0 - w) * getsample((short *)p->tail, (p->fpos + i) * nch + j, p->nbps) +
+		  ((b) ? (w * getsample((short *)b, i * nch + j, p->nbps)) : (0.0)));
+    }
+    if ((status = wavout_put(p, p->blk, k)) != 0)
+      return(status);
+    p->fpos += k;
+    if (b)
+      b += (size_t)k * p->bpf;
+    n -= k;
+  }
+
+  return(0);
+}
+
+/* --------------------------------------------------------------------- */
+/* ----- int wavout_write(wavout_t *, const char *, unsigned long) ----- */
+/* --------------------------------------------------------------------- */
+int wavout_write(wavout_t *p, const char *b, unsigned long n)
+{
+  unsigned long k;
+  int status;
+
+  if (p->tail == NULL)
+    return(wavout_put(p, b, n));
+
+  /* first frames of a segment: crossfade with the end of the previous one */
+  if (p->fpos < p->nfade) {
+    k = (n < p->nfade - p->fpos) ? (n) : (p->nfade - p->fpos);
+    if ((status = wavout_fade(p, b, k)) != 0)
+      return(status);
+    b += (size_t)k * p->bpf;
+    n -= k;
+    if (p->fpos < p->nfade)
+      return(0);
+    p->ntail = p->nfade = p->fpos = 0;
+  }
+
+  /* hold the last ngap frames back, writing the older ones out */
+  if (p->ntail + n > p->ngap) {
+    k = p->ntail + n - p->ngap;
+    if (k > p->ntail)
+      k = p->ntail;
+    if ((status = wavout_put(p, p->tail, k)) != 0)
+      return(status);
+    memmove(p->tail, p->tail + (size_t)k * p->bpf, (size_t)(p->ntail - k) * p->bpf);
+    p->ntail -= k;
+
+    k = (p->ntail + n > p->ngap) ? (p->ntail + n - p->ngap) : (0);
+    if ((status = wavout_put(p, b, k)) != 0)
+      return(status);
+    b += (size_t)k * p->bpf;
+    n -= k;
+  }
+
+  memcpy(p->tail + (size_t)p->ntail * p->bpf, b, (size_t)n * p->bpf);
+  p->ntail += n;
+
+  return(0);
+}
+
+/* ------------------------------------------------------------------------------ */
+/* ----- int wavout_copy(wavout_t *, FILE *, long long, unsigned long long) ----- */
+/* ------------------------------------------------------------------------------ */
+/*
+ * Copy n frames from offset off of infp, kernel side when possible,
+ * i.e. unless the frames have to go through a crossfade.
+ */
+int wavout_copy(wavout_t *p, FILE *infp, long long off, unsigned long long n)
+{
+  char buffer[WAVOUT_COPY_BLOCK];
+  long long len = (long long)n * p->bpf, done = 0;
+  size_t k, r, max = sizeof(buffer) / p->bpf * p->bpf;
+  int status = 0;
+
+  if (p->tail == NULL && len > 0) {
+    done = fsplice(infp, off, len, p->f);
+    MWSTATS_ADD(p->stats, nfwrite, 1);
+    MWSTATS_ADD(p->stats, nbytes_read, (unsigned long long)done);
+    /* a short copy may stop inside a frame: back up to the last whole one */
+    if (done % p->bpf && fseek64(p->f, -(done % p->bpf), SEEK_CUR)) {
+      fprintf(stderr, "wavout_copy() -- cannot seek output samples\n");
+      return(SPRO_SIG_WRITE_ERR);
+    }
+    done -= done % p->bpf;
+    MWSTATS_ADD(p->stats, nbytes_written, (unsigned long long)done);
+  }
+
+  if (done < len)
+    MWSTATS_ADD(p->stats, nfseek, 1);
+  if (done < len && fseek64(infp, off + done, SEEK_SET)) {
+    fprintf(stderr, "wavout_copy() -- cannot seek input samples\n");
+    return(SPRO_SIG_READ_ERR);
+  }
+
+  /* buffered copy of the rest, up to the last whole frame of a truncated input */
+  for (; done < len && status == 0; done += (long long)k) {
+    k = (len - done < (long long)max) ? (size_t)(len - done) : max;
+    MWSTATS_ADD(p->stats, nfread, 1);
+    r = fread(buffer, 1, k, infp);
+    MWSTATS_ADD(p->stats, nbytes_read, (unsigned long long)r);
+    if (r < k)
+      len = done + (long long)(r - r % p->bpf);
+    if ((k = r - r % p->bpf) == 0)
+      break;
+    if (p->tail)
+      status = wavout_write(p, buffer, (unsigned long)(k / p->bpf));
+    else {
+      MWSTATS_ADD(p->stats, nfwrite, 1);
+      MWSTATS_ADD(p->stats, nbytes_written, (unsigned long long)k);
+      if (fwrite(buffer, 1, k, p->f) != k) {
+	fprintf(stderr, "wavout_copy() -- cannot write output samples\n");
+	status = SPRO_SIG_WRITE_ERR;
+      }
+    }
+  }
+
+  if (p->tail == NULL)
+    p->nwritten += done / p->bpf;
+
+  return(status);
+}
+
+/* -------------------------------------- */
+/* ----- int wavout_gap(wavout_t *) ----- */
+/* -------------------------------------- */
+int wavout_gap(wavout_t *p)
+{
+  unsigned long n, k;
+  int status;
+
+  MWSTATS_ADD(p->stats, nseg, 1);
+
+  if (p->ngap == 0)
+    return(0);
+
+  if (p->mode == WAVOUT_CROSSFADE) {
+    /* segment shorter than the overlap: the previous one fades out into silence */
+    if (p->fpos < p->nfade) {
+      if ((status = wavout_fade(p, NULL, p->nfade - p->fpos)) != 0)
+	return(status);
+      p->ntail = 0;
+    }
+    p->nfade = p->ntail;
+    p->fpos = 0;
+    return(0);
+  }
+
+  if (p->blk == NULL) {
+    MWSTATS_ADD(p->stats, nfseek, 1);
+    MWSTATS_ADD(p->stats, nbytes_written, (unsigned long long)p->ngap * p->bpf);
+    if (fzero(p->f, (long long)p->ngap * p->bpf)) {
+      fprintf(stderr, "wavout_gap() -- cannot write output padding\n");
+      return(SPRO_SIG_WRITE_ERR);
+    }
+    p->nwritten += p->ngap;
+    return(0);
+  }
+
+  for (n = p->ngap; n; n -= k) {
+    k = (n < p->nblk) ? (n) : (p->nblk);
+    if ((status = wavout_put(p, p->blk, k)) != 0)
+      return(status);
+  }
+
+  return(0);
+}
+
+/* ---------------------------------------- */
+/* ----- int wavout_flush(wavout_t *) ----- */
+/* ---------------------------------------- */
+/*
+ * Write out the end of the last segment, which no segment follows to
+ * crossfade with.
+ */
+int wavout_flush(wavout_t *p)
+{
+  int status;
+
+  if (p->tail == NULL)
+    return(0);
+
+  status = wavout_put(p, p->tail + (size_t)p->fpos * p->bpf, p->ntail - p->fpos);
+  p->ntail = p->nfade = p->fpos = 0;
+
+  return(status);
+}